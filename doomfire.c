@@ -0,0 +1,1581 @@
+/**
+ * doomfire.c - Shared Doom fire simulation core
+ *
+ * See doomfire.h for the API. Everything here is per instance: several fires
+ * can run side by side, each with its own buffers, RNG seed and worker pool.
+ *
+ * Compile with:
+ *   clang -O3 -c doomfire.c
+ *
+ * No -march flag is needed: the SIMD kernels are compiled per target and
+ * picked at create time from what the CPU reports.
+ */
+
+#define _DEFAULT_SOURCE
+#include "doomfire.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIRE_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FIRE_NEON 1
+#endif
+
+const char *const doomfire_propagation_names[DOOMFIRE_PROPAGATION_COUNT] = {
+    "push", "pull"};
+
+const char *const doomfire_kernel_names[DOOMFIRE_KERNEL_COUNT] = {
+    "scalar", "sse2", "avx2", "avx512", "neon"};
+
+// --- Worker Pool ---
+//
+// Persistent threads that run one parallel-for per call. The calling thread
+// takes part in the work, so a pool of size N spawns N - 1 workers, once, and
+// each frame only costs a wake-up.
+
+typedef void (*TaskFn)(int task, int worker, void *arg);
+
+typedef struct FirePool FirePool;
+
+typedef struct {
+  FirePool *pool;
+  int index;
+} FireWorker;
+
+struct FirePool {
+  pthread_t *threads;
+  FireWorker *workers;
+  int size; // including the calling thread
+  pthread_mutex_t lock;
+  pthread_cond_t wake, idle;
+  uint64_t generation; // bumped once per pool_run()
+  int busy;            // workers still inside the current generation
+  bool quit;
+  TaskFn fn;
+  void *arg;
+  int tasks;
+  atomic_int next_task;
+};
+
+static void pool_drain(FirePool *pool, int worker) {
+  int t;
+  while ((t = atomic_fetch_add(&pool->next_task, 1)) < pool->tasks)
+    pool->fn(t, worker, pool->arg);
+}
+
+static void *pool_worker(void *p) {
+  FireWorker *self = p;
+  FirePool *pool = self->pool;
+  pthread_mutex_lock(&pool->lock);
+  uint64_t seen = 0; // workers are spawned before the first pool_run()
+  for (;;) {
+    while (pool->generation == seen && !pool->quit)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    if (pool->quit)
+      break;
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    pool_drain(pool, self->index);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busy == 0)
+      pthread_cond_signal(&pool->idle);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+static void pool_stop(FirePool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 1; i < pool->size; i++)
+    pthread_join(pool->threads[i - 1], NULL);
+  free(pool->threads);
+  free(pool->workers);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->idle);
+}
+
+// Spawns up to size - 1 workers; pool->size says how many made it
+static void pool_start(FirePool *pool, int size) {
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+  pool->size = 1;
+  pool->threads = size > 1 ? malloc(sizeof(pthread_t) * (size - 1)) : NULL;
+  pool->workers = size > 1 ? malloc(sizeof(FireWorker) * (size - 1)) : NULL;
+  if (!pool->threads || !pool->workers)
+    return;
+  for (int i = 1; i < size; i++) {
+    pool->workers[i - 1] = (FireWorker){.pool = pool, .index = i};
+    if (pthread_create(&pool->threads[i - 1], NULL, pool_worker,
+                       &pool->workers[i - 1]) != 0)
+      break;
+    pool->size++;
+  }
+}
+
+// Run fn(task, worker, arg) for every task in [0, tasks) and wait for all
+static void pool_run(FirePool *pool, TaskFn fn, void *arg, int tasks) {
+  if (pool->size == 1 || tasks <= 1) {
+    for (int t = 0; t < tasks; t++)
+      fn(t, 0, arg);
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->fn = fn;
+  pool->arg = arg;
+  pool->tasks = tasks;
+  atomic_store(&pool->next_task, 0);
+  pool->busy = pool->size - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  pool_drain(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy > 0)
+    pthread_cond_wait(&pool->idle, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// --- Propagation Kernels ---
+//
+// A row kernel computes row y from row y+1 (src) and the row's random bytes.
+// The reference is the classic push loop: every source cell writes to x-1, x
+// or x+1, and later writes win. The SIMD kernels compute the same result as a
+// gather, so each destination byte has exactly one writer:
+//
+//   dst[x] = src[x+1] pushed left   ? src[x+1] - decay[x+1]
+//          : src[x] is 0 or stays   ? src[x]   - decay[x]
+//          : src[x-1] pushed right  ? src[x-1] - decay[x-1]
+//          : dst[x] (untouched this frame)
+//
+// Random bytes map to small ranges by comparing against the thresholds of
+// fire_rng_range(), which is exact and cheap in SIMD: range(r, n) >= i exactly
+// when r >= ceil(i * 256 / n). Subtraction saturates instead of clamping.
+//
+// Edge handling only differs in the first and last cell of a row, which every
+// kernel leaves to the scalar gather.
+
+// Per-instance constants the row kernels need. A row holds `lanes`
+// interleaved instances: byte i is cell i / lanes of instance i % lanes, and
+// its neighbours sit `lanes` bytes away. Single fires have one lane.
+typedef struct {
+  int w;
+  int lanes;
+  int n;      // bytes per row, w * lanes
+  int levels; // decay is drawn from [0, levels)
+  DoomFireEdge edge;
+  uint8_t decay_t[256]; // decay >= k exactly when r >= decay_t[k]
+} RowParams;
+
+typedef void (*PropagateFn)(uint8_t *dst, const uint8_t *src,
+                            const uint8_t *decay_r, const uint8_t *dir_r,
+                            const RowParams *p);
+
+// Pull kernels write dst from the previous frame's row (old) and the row
+// below it (src)
+typedef void (*PullFn)(uint8_t *dst, const uint8_t *old, const uint8_t *src,
+                       const uint8_t *decay_r, const uint8_t *dir_r,
+                       const RowParams *p);
+
+// 16-bit heat: a cell holds the 8-bit heat in its high byte plus a fraction,
+// and decay is drawn from [0, levels) for up to 65535 levels, in 1/256 steps
+// of the 8-bit scale. That is too many levels for thresholds, so the SIMD
+// kernels compute range(r, levels) = (r * levels) >> 8 with a high multiply.
+typedef void (*PropagateFn16)(uint16_t *dst, const uint16_t *src,
+                              const uint8_t *decay_r, const uint8_t *dir_r,
+                              const RowParams *p);
+typedef void (*PullFn16)(uint16_t *dst, const uint16_t *old,
+                         const uint16_t *src, const uint8_t *decay_r,
+                         const uint8_t *dir_r, const RowParams *p);
+
+// Pull form: every destination cell reads one randomly chosen source from the
+// previous frame and is written exactly once, so rows vectorize directly and
+// the frame can be split anywhere. To look like push, the choice follows the
+// odds of the push loop on a lit row: the right neighbour wins 1/3 of the
+// time, then the cell below 2/9, the left neighbour 4/27, and for the other
+// 8/27 nobody pushes into the cell and it keeps last frame's value. A cold
+// neighbour would not have pushed anything, so the cell below is used instead.
+
+#define DIR_T1 86  // range(r, 3) >= 1
+#define DIR_T2 171 // range(r, 3) >= 2
+
+#define PULL_T_LEFT 76   // r >= 76: take x-1 (below: keep the old value)
+#define PULL_T_MID 114   // r >= 114: take x
+#define PULL_T_RIGHT 171 // r >= 171: take x+1
+
+static inline uint8_t range_threshold(int i, int n) {
+  return (uint8_t)((i * 256 + n - 1) / n);
+}
+
+static inline int sub_sat(int val, int decay) {
+  return val > decay ? val - decay : 0;
+}
+
+// Cells are uint8_t, or uint16_t in 16-bit mode (`wide`). The scalar code is
+// shared by both; every caller passes `wide` as a constant, so it folds away.
+static inline int cell_get(const void *row, int x, bool wide) {
+  return wide ? ((const uint16_t *)row)[x] : ((const uint8_t *)row)[x];
+}
+
+static inline void cell_set(void *row, int x, int v, bool wide) {
+  if (wide)
+    ((uint16_t *)row)[x] = (uint16_t)v;
+  else
+    ((uint8_t *)row)[x] = (uint8_t)v;
+}
+
+static inline void propagate_cells(void *dst, const void *src,
+                                   const uint8_t *decay_r,
+                                   const uint8_t *dir_r, const RowParams *p,
+                                   bool wide) {
+  int n = p->n, lanes = p->lanes;
+  for (int x = 0; x < n; x++) {
+    int decay = fire_rng_range(decay_r[x], p->levels);
+
+    // Read from the pixel below
+    int val = cell_get(src, x, wide);
+
+    // Add some randomness from neighbors to simulate wind/diffusion
+    if (val > 0) {
+      int rand_idx = fire_rng_range(dir_r[x], 3); // 0, 1, 2
+      int dst_x = x + (1 - rand_idx) * lanes;     // x-1, x, x+1
+      if ((rand_idx == 2 && x < lanes) || (rand_idx == 0 && x >= n - lanes)) {
+        // Pushed off the edge of its own instance
+        if (p->edge == DOOMFIRE_EDGE_CLIP)
+          continue;
+        dst_x = x;
+      }
+      cell_set(dst, dst_x, sub_sat(val, decay), wide);
+    } else {
+      cell_set(dst, x, 0, wide);
+    }
+  }
+}
+
+static void propagate_row_scalar(uint8_t *dst, const uint8_t *src,
+                                 const uint8_t *decay_r, const uint8_t *dir_r,
+                                 const RowParams *p) {
+  propagate_cells(dst, src, decay_r, dir_r, p, false);
+}
+
+static void propagate_row16_scalar(uint16_t *dst, const uint16_t *src,
+                                   const uint8_t *decay_r,
+                                   const uint8_t *dir_r, const RowParams *p) {
+  propagate_cells(dst, src, decay_r, dir_r, p, true);
+}
+
+// One destination cell of the gather form, used for row edges and tails. With
+// clamped edges the edge cells also receive their own heat pushed outwards.
+static inline int gather_cell(const void *dst, const void *src,
+                              const uint8_t *decay_r, const uint8_t *dir_r,
+                              const RowParams *p, int x, bool wide) {
+  int lanes = p->lanes;
+  bool first = x < lanes, last = x >= p->n - lanes;
+  bool clamp = p->edge == DOOMFIRE_EDGE_CLAMP;
+  int r = x + lanes, l = x - lanes;
+  int s_m = cell_get(src, x, wide);
+  if (!last && cell_get(src, r, wide) && dir_r[r] >= DIR_T2)
+    return sub_sat(cell_get(src, r, wide),
+                   fire_rng_range(decay_r[r], p->levels));
+  if (!s_m || (dir_r[x] >= DIR_T1 && dir_r[x] < DIR_T2) ||
+      (clamp && first && dir_r[x] >= DIR_T2) ||
+      (clamp && last && dir_r[x] < DIR_T1))
+    return sub_sat(s_m, fire_rng_range(decay_r[x], p->levels));
+  if (!first && cell_get(src, l, wide) && dir_r[l] < DIR_T1)
+    return sub_sat(cell_get(src, l, wide),
+                   fire_rng_range(decay_r[l], p->levels));
+  return cell_get(dst, x, wide);
+}
+
+static inline void gather_span(void *dst, const void *src,
+                               const uint8_t *decay_r, const uint8_t *dir_r,
+                               const RowParams *p, int from, int to,
+                               bool wide) {
+  for (int x = from; x < to; x++)
+    cell_set(dst, x, gather_cell(dst, src, decay_r, dir_r, p, x, wide), wide);
+}
+
+// Scalar pull for cells [from, to), also used for SIMD row edges and tails
+static inline void pull_span(void *dst, const void *old, const void *src,
+                             const uint8_t *decay_r, const uint8_t *dir_r,
+                             const RowParams *p, int from, int to, bool wide) {
+  int n = p->n, lanes = p->lanes;
+  for (int x = from; x < to; x++) {
+    uint8_t r = dir_r[x];
+    if (r < PULL_T_LEFT) {
+      cell_set(dst, x, cell_get(old, x, wide), wide);
+      continue;
+    }
+    int src_x = r >= PULL_T_RIGHT ? x + lanes : r >= PULL_T_MID ? x : x - lanes;
+    // Past the edge of the instance, clamping lands on x itself, and clipping
+    // finds no heat and falls back to x as well
+    bool off = (r >= PULL_T_RIGHT && x >= n - lanes) ||
+               (r < PULL_T_MID && x < lanes);
+    int val = off ? 0 : cell_get(src, src_x, wide);
+    if (!val)
+      val = cell_get(src, x, wide);
+    cell_set(dst, x, sub_sat(val, fire_rng_range(decay_r[x], p->levels)),
+             wide);
+  }
+}
+
+static void pull_row_scalar(uint8_t *dst, const uint8_t *old,
+                            const uint8_t *src, const uint8_t *decay_r,
+                            const uint8_t *dir_r, const RowParams *p) {
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, p->n, false);
+}
+
+static void pull_row16_scalar(uint16_t *dst, const uint16_t *old,
+                              const uint16_t *src, const uint8_t *decay_r,
+                              const uint8_t *dir_r, const RowParams *p) {
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, p->n, true);
+}
+
+#ifdef FIRE_X86
+
+static inline __m128i ge_sse2(__m128i a, uint8_t t) {
+  return _mm_cmpeq_epi8(_mm_max_epu8(a, _mm_set1_epi8((char)t)), a);
+}
+
+// Decay for 16 lanes starting at i
+static inline __m128i decay_sse2(const uint8_t *decay_r, const RowParams *p,
+                                 int i) {
+  __m128i r = _mm_loadu_si128((const __m128i *)(decay_r + i));
+  __m128i d = _mm_setzero_si128();
+  for (int k = 1; k < p->levels; k++)
+    d = _mm_sub_epi8(d, ge_sse2(r, p->decay_t[k]));
+  return d;
+}
+
+// src - decay for 16 lanes starting at i
+static inline __m128i cooled_sse2(const uint8_t *src, const uint8_t *decay_r,
+                                  const RowParams *p, int i) {
+  return _mm_subs_epu8(_mm_loadu_si128((const __m128i *)(src + i)),
+                       decay_sse2(decay_r, p, i));
+}
+
+static inline __m128i select_sse2(__m128i m, __m128i a, __m128i b) {
+  return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+static void propagate_row_sse2(uint8_t *dst, const uint8_t *src,
+                               const uint8_t *decay_r, const uint8_t *dir_r,
+                               const RowParams *p) {
+  const __m128i zero = _mm_setzero_si128();
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  gather_span(dst, src, decay_r, dir_r, p, 0, lanes, false);
+  for (; x + 16 + lanes <= n; x += 16) {
+    __m128i s_l = _mm_loadu_si128((const __m128i *)(src + x - lanes));
+    __m128i s_m = _mm_loadu_si128((const __m128i *)(src + x));
+    __m128i s_r = _mm_loadu_si128((const __m128i *)(src + x + lanes));
+    __m128i r_l = _mm_loadu_si128((const __m128i *)(dir_r + x - lanes));
+    __m128i r_m = _mm_loadu_si128((const __m128i *)(dir_r + x));
+    __m128i r_r = _mm_loadu_si128((const __m128i *)(dir_r + x + lanes));
+
+    __m128i w_l = _mm_andnot_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(s_l, zero), ge_sse2(r_l, DIR_T1)),
+        _mm_cmpeq_epi8(zero, zero));
+    __m128i w_m =
+        _mm_or_si128(_mm_cmpeq_epi8(s_m, zero),
+                     _mm_andnot_si128(ge_sse2(r_m, DIR_T2), ge_sse2(r_m, DIR_T1)));
+    __m128i w_r = _mm_andnot_si128(_mm_cmpeq_epi8(s_r, zero), ge_sse2(r_r, DIR_T2));
+
+    __m128i res = _mm_loadu_si128((const __m128i *)(dst + x));
+    res = select_sse2(w_l, cooled_sse2(src, decay_r, p, x - lanes), res);
+    res = select_sse2(w_m, cooled_sse2(src, decay_r, p, x), res);
+    res = select_sse2(w_r, cooled_sse2(src, decay_r, p, x + lanes), res);
+    _mm_storeu_si128((__m128i *)(dst + x), res);
+  }
+  gather_span(dst, src, decay_r, dir_r, p, x, n, false);
+}
+
+static void pull_row_sse2(uint8_t *dst, const uint8_t *old,
+                          const uint8_t *src, const uint8_t *decay_r,
+                          const uint8_t *dir_r, const RowParams *p) {
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, lanes, false);
+  for (; x + 16 + lanes <= n; x += 16) {
+    __m128i r = _mm_loadu_si128((const __m128i *)(dir_r + x));
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + x - lanes));
+    v = select_sse2(ge_sse2(r, PULL_T_MID),
+                    _mm_loadu_si128((const __m128i *)(src + x)), v);
+    v = select_sse2(ge_sse2(r, PULL_T_RIGHT),
+                    _mm_loadu_si128((const __m128i *)(src + x + lanes)), v);
+    v = select_sse2(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                    _mm_loadu_si128((const __m128i *)(src + x)), v);
+    v = _mm_subs_epu8(v, decay_sse2(decay_r, p, x));
+    v = select_sse2(ge_sse2(r, PULL_T_LEFT), v,
+                    _mm_loadu_si128((const __m128i *)(old + x)));
+    _mm_storeu_si128((__m128i *)(dst + x), v);
+  }
+  pull_span(dst, old, src, decay_r, dir_r, p, x, n, false);
+}
+
+// 8 random bytes starting at i, one per 16-bit lane
+static inline __m128i widen_sse2(const uint8_t *r, int i) {
+  return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r + i)),
+                           _mm_setzero_si128());
+}
+
+// Widened random bytes are below 256, so a signed compare is exact
+static inline __m128i ge16_sse2(__m128i a, uint8_t t) {
+  return _mm_cmpgt_epi16(a, _mm_set1_epi16(t - 1));
+}
+
+// Decay for 8 cells of 16-bit heat starting at i
+static inline __m128i decay16_sse2(const uint8_t *decay_r, const RowParams *p,
+                                   int i) {
+  return _mm_mulhi_epu16(_mm_slli_epi16(widen_sse2(decay_r, i), 8),
+                         _mm_set1_epi16((short)p->levels));
+}
+
+static inline __m128i cooled16_sse2(const uint16_t *src,
+                                    const uint8_t *decay_r, const RowParams *p,
+                                    int i) {
+  return _mm_subs_epu16(_mm_loadu_si128((const __m128i *)(src + i)),
+                        decay16_sse2(decay_r, p, i));
+}
+
+static void propagate_row16_sse2(uint16_t *dst, const uint16_t *src,
+                                 const uint8_t *decay_r, const uint8_t *dir_r,
+                                 const RowParams *p) {
+  const __m128i zero = _mm_setzero_si128();
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  gather_span(dst, src, decay_r, dir_r, p, 0, lanes, true);
+  for (; x + 8 + lanes <= n; x += 8) {
+    __m128i s_l = _mm_loadu_si128((const __m128i *)(src + x - lanes));
+    __m128i s_m = _mm_loadu_si128((const __m128i *)(src + x));
+    __m128i s_r = _mm_loadu_si128((const __m128i *)(src + x + lanes));
+    __m128i r_l = widen_sse2(dir_r, x - lanes);
+    __m128i r_m = widen_sse2(dir_r, x);
+    __m128i r_r = widen_sse2(dir_r, x + lanes);
+
+    __m128i w_l = _mm_andnot_si128(
+        _mm_or_si128(_mm_cmpeq_epi16(s_l, zero), ge16_sse2(r_l, DIR_T1)),
+        _mm_cmpeq_epi16(zero, zero));
+    __m128i w_m = _mm_or_si128(
+        _mm_cmpeq_epi16(s_m, zero),
+        _mm_andnot_si128(ge16_sse2(r_m, DIR_T2), ge16_sse2(r_m, DIR_T1)));
+    __m128i w_r =
+        _mm_andnot_si128(_mm_cmpeq_epi16(s_r, zero), ge16_sse2(r_r, DIR_T2));
+
+    __m128i res = _mm_loadu_si128((const __m128i *)(dst + x));
+    res = select_sse2(w_l, cooled16_sse2(src, decay_r, p, x - lanes), res);
+    res = select_sse2(w_m, cooled16_sse2(src, decay_r, p, x), res);
+    res = select_sse2(w_r, cooled16_sse2(src, decay_r, p, x + lanes), res);
+    _mm_storeu_si128((__m128i *)(dst + x), res);
+  }
+  gather_span(dst, src, decay_r, dir_r, p, x, n, true);
+}
+
+static void pull_row16_sse2(uint16_t *dst, const uint16_t *old,
+                            const uint16_t *src, const uint8_t *decay_r,
+                            const uint8_t *dir_r, const RowParams *p) {
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, lanes, true);
+  for (; x + 8 + lanes <= n; x += 8) {
+    __m128i r = widen_sse2(dir_r, x);
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + x - lanes));
+    v = select_sse2(ge16_sse2(r, PULL_T_MID),
+                    _mm_loadu_si128((const __m128i *)(src + x)), v);
+    v = select_sse2(ge16_sse2(r, PULL_T_RIGHT),
+                    _mm_loadu_si128((const __m128i *)(src + x + lanes)), v);
+    v = select_sse2(_mm_cmpeq_epi16(v, _mm_setzero_si128()),
+                    _mm_loadu_si128((const __m128i *)(src + x)), v);
+    v = _mm_subs_epu16(v, decay16_sse2(decay_r, p, x));
+    v = select_sse2(ge16_sse2(r, PULL_T_LEFT), v,
+                    _mm_loadu_si128((const __m128i *)(old + x)));
+    _mm_storeu_si128((__m128i *)(dst + x), v);
+  }
+  pull_span(dst, old, src, decay_r, dir_r, p, x, n, true);
+}
+
+__attribute__((target("avx2"))) static inline __m256i ge_avx2(__m256i a,
+                                                               uint8_t t) {
+  return _mm256_cmpeq_epi8(_mm256_max_epu8(a, _mm256_set1_epi8((char)t)), a);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+decay_avx2(const uint8_t *decay_r, const RowParams *p, int i) {
+  __m256i r = _mm256_loadu_si256((const __m256i *)(decay_r + i));
+  __m256i d = _mm256_setzero_si256();
+  for (int k = 1; k < p->levels; k++)
+    d = _mm256_sub_epi8(d, ge_avx2(r, p->decay_t[k]));
+  return d;
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+cooled_avx2(const uint8_t *src, const uint8_t *decay_r, const RowParams *p,
+            int i) {
+  return _mm256_subs_epu8(_mm256_loadu_si256((const __m256i *)(src + i)),
+                          decay_avx2(decay_r, p, i));
+}
+
+__attribute__((target("avx2"))) static void
+propagate_row_avx2(uint8_t *dst, const uint8_t *src, const uint8_t *decay_r,
+                   const uint8_t *dir_r, const RowParams *p) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_cmpeq_epi8(zero, zero);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  gather_span(dst, src, decay_r, dir_r, p, 0, lanes, false);
+  for (; x + 32 + lanes <= n; x += 32) {
+    __m256i s_l = _mm256_loadu_si256((const __m256i *)(src + x - lanes));
+    __m256i s_m = _mm256_loadu_si256((const __m256i *)(src + x));
+    __m256i s_r = _mm256_loadu_si256((const __m256i *)(src + x + lanes));
+    __m256i r_l = _mm256_loadu_si256((const __m256i *)(dir_r + x - lanes));
+    __m256i r_m = _mm256_loadu_si256((const __m256i *)(dir_r + x));
+    __m256i r_r = _mm256_loadu_si256((const __m256i *)(dir_r + x + lanes));
+
+    __m256i w_l = _mm256_andnot_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(s_l, zero), ge_avx2(r_l, DIR_T1)),
+        ones);
+    __m256i w_m = _mm256_or_si256(
+        _mm256_cmpeq_epi8(s_m, zero),
+        _mm256_andnot_si256(ge_avx2(r_m, DIR_T2), ge_avx2(r_m, DIR_T1)));
+    __m256i w_r =
+        _mm256_andnot_si256(_mm256_cmpeq_epi8(s_r, zero), ge_avx2(r_r, DIR_T2));
+
+    __m256i res = _mm256_loadu_si256((const __m256i *)(dst + x));
+    res = _mm256_blendv_epi8(res, cooled_avx2(src, decay_r, p, x - lanes), w_l);
+    res = _mm256_blendv_epi8(res, cooled_avx2(src, decay_r, p, x), w_m);
+    res = _mm256_blendv_epi8(res, cooled_avx2(src, decay_r, p, x + lanes), w_r);
+    _mm256_storeu_si256((__m256i *)(dst + x), res);
+  }
+  gather_span(dst, src, decay_r, dir_r, p, x, n, false);
+}
+
+__attribute__((target("avx2"))) static void
+pull_row_avx2(uint8_t *dst, const uint8_t *old, const uint8_t *src,
+              const uint8_t *decay_r, const uint8_t *dir_r,
+              const RowParams *p) {
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, lanes, false);
+  for (; x + 32 + lanes <= n; x += 32) {
+    __m256i r = _mm256_loadu_si256((const __m256i *)(dir_r + x));
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + x - lanes));
+    v = _mm256_blendv_epi8(v, _mm256_loadu_si256((const __m256i *)(src + x)),
+                           ge_avx2(r, PULL_T_MID));
+    v = _mm256_blendv_epi8(
+        v, _mm256_loadu_si256((const __m256i *)(src + x + lanes)),
+        ge_avx2(r, PULL_T_RIGHT));
+    v = _mm256_blendv_epi8(v, _mm256_loadu_si256((const __m256i *)(src + x)),
+                           _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    v = _mm256_blendv_epi8(_mm256_loadu_si256((const __m256i *)(old + x)),
+                           _mm256_subs_epu8(v, decay_avx2(decay_r, p, x)),
+                           ge_avx2(r, PULL_T_LEFT));
+    _mm256_storeu_si256((__m256i *)(dst + x), v);
+  }
+  pull_span(dst, old, src, decay_r, dir_r, p, x, n, false);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+widen_avx2(const uint8_t *r, int i) {
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(r + i)));
+}
+
+__attribute__((target("avx2"))) static inline __m256i ge16_avx2(__m256i a,
+                                                                 uint8_t t) {
+  return _mm256_cmpgt_epi16(a, _mm256_set1_epi16(t - 1));
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+decay16_avx2(const uint8_t *decay_r, const RowParams *p, int i) {
+  return _mm256_mulhi_epu16(_mm256_slli_epi16(widen_avx2(decay_r, i), 8),
+                            _mm256_set1_epi16((short)p->levels));
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+cooled16_avx2(const uint16_t *src, const uint8_t *decay_r, const RowParams *p,
+              int i) {
+  return _mm256_subs_epu16(_mm256_loadu_si256((const __m256i *)(src + i)),
+                           decay16_avx2(decay_r, p, i));
+}
+
+__attribute__((target("avx2"))) static void
+propagate_row16_avx2(uint16_t *dst, const uint16_t *src, const uint8_t *decay_r,
+                     const uint8_t *dir_r, const RowParams *p) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_cmpeq_epi16(zero, zero);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  gather_span(dst, src, decay_r, dir_r, p, 0, lanes, true);
+  for (; x + 16 + lanes <= n; x += 16) {
+    __m256i s_l = _mm256_loadu_si256((const __m256i *)(src + x - lanes));
+    __m256i s_m = _mm256_loadu_si256((const __m256i *)(src + x));
+    __m256i s_r = _mm256_loadu_si256((const __m256i *)(src + x + lanes));
+    __m256i r_l = widen_avx2(dir_r, x - lanes);
+    __m256i r_m = widen_avx2(dir_r, x);
+    __m256i r_r = widen_avx2(dir_r, x + lanes);
+
+    __m256i w_l = _mm256_andnot_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi16(s_l, zero), ge16_avx2(r_l, DIR_T1)),
+        ones);
+    __m256i w_m = _mm256_or_si256(
+        _mm256_cmpeq_epi16(s_m, zero),
+        _mm256_andnot_si256(ge16_avx2(r_m, DIR_T2), ge16_avx2(r_m, DIR_T1)));
+    __m256i w_r = _mm256_andnot_si256(_mm256_cmpeq_epi16(s_r, zero),
+                                      ge16_avx2(r_r, DIR_T2));
+
+    __m256i res = _mm256_loadu_si256((const __m256i *)(dst + x));
+    res =
+        _mm256_blendv_epi8(res, cooled16_avx2(src, decay_r, p, x - lanes), w_l);
+    res = _mm256_blendv_epi8(res, cooled16_avx2(src, decay_r, p, x), w_m);
+    res =
+        _mm256_blendv_epi8(res, cooled16_avx2(src, decay_r, p, x + lanes), w_r);
+    _mm256_storeu_si256((__m256i *)(dst + x), res);
+  }
+  gather_span(dst, src, decay_r, dir_r, p, x, n, true);
+}
+
+__attribute__((target("avx2"))) static void
+pull_row16_avx2(uint16_t *dst, const uint16_t *old, const uint16_t *src,
+                const uint8_t *decay_r, const uint8_t *dir_r,
+                const RowParams *p) {
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, lanes, true);
+  for (; x + 16 + lanes <= n; x += 16) {
+    __m256i r = widen_avx2(dir_r, x);
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + x - lanes));
+    v = _mm256_blendv_epi8(v, _mm256_loadu_si256((const __m256i *)(src + x)),
+                           ge16_avx2(r, PULL_T_MID));
+    v = _mm256_blendv_epi8(
+        v, _mm256_loadu_si256((const __m256i *)(src + x + lanes)),
+        ge16_avx2(r, PULL_T_RIGHT));
+    v = _mm256_blendv_epi8(v, _mm256_loadu_si256((const __m256i *)(src + x)),
+                           _mm256_cmpeq_epi16(v, _mm256_setzero_si256()));
+    v = _mm256_blendv_epi8(_mm256_loadu_si256((const __m256i *)(old + x)),
+                           _mm256_subs_epu16(v, decay16_avx2(decay_r, p, x)),
+                           ge16_avx2(r, PULL_T_LEFT));
+    _mm256_storeu_si256((__m256i *)(dst + x), v);
+  }
+  pull_span(dst, old, src, decay_r, dir_r, p, x, n, true);
+}
+
+#define AVX512_TARGET __attribute__((target("avx512f,avx512bw")))
+
+AVX512_TARGET static inline __m512i decay_avx512(const uint8_t *decay_r,
+                                                 const RowParams *p, int i) {
+  __m512i r = _mm512_loadu_si512(decay_r + i);
+  __m512i d = _mm512_setzero_si512();
+  const __m512i one = _mm512_set1_epi8(1);
+  for (int k = 1; k < p->levels; k++) {
+    __mmask64 ge =
+        _mm512_cmpge_epu8_mask(r, _mm512_set1_epi8((char)p->decay_t[k]));
+    d = _mm512_mask_add_epi8(d, ge, d, one);
+  }
+  return d;
+}
+
+AVX512_TARGET static inline __m512i cooled_avx512(const uint8_t *src,
+                                                  const uint8_t *decay_r,
+                                                  const RowParams *p, int i) {
+  return _mm512_subs_epu8(_mm512_loadu_si512(src + i),
+                          decay_avx512(decay_r, p, i));
+}
+
+AVX512_TARGET static void propagate_row_avx512(uint8_t *dst,
+                                               const uint8_t *src,
+                                               const uint8_t *decay_r,
+                                               const uint8_t *dir_r,
+                                               const RowParams *p) {
+  const __m512i t1 = _mm512_set1_epi8((char)DIR_T1);
+  const __m512i t2 = _mm512_set1_epi8((char)DIR_T2);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  gather_span(dst, src, decay_r, dir_r, p, 0, lanes, false);
+  for (; x + 64 + lanes <= n; x += 64) {
+    __m512i s_l = _mm512_loadu_si512(src + x - lanes);
+    __m512i s_m = _mm512_loadu_si512(src + x);
+    __m512i s_r = _mm512_loadu_si512(src + x + lanes);
+    __m512i r_l = _mm512_loadu_si512(dir_r + x - lanes);
+    __m512i r_m = _mm512_loadu_si512(dir_r + x);
+    __m512i r_r = _mm512_loadu_si512(dir_r + x + lanes);
+
+    __mmask64 w_l = _mm512_test_epi8_mask(s_l, s_l) &
+                    ~_mm512_cmpge_epu8_mask(r_l, t1);
+    __mmask64 w_m = ~_mm512_test_epi8_mask(s_m, s_m) |
+                    (_mm512_cmpge_epu8_mask(r_m, t1) &
+                     ~_mm512_cmpge_epu8_mask(r_m, t2));
+    __mmask64 w_r =
+        _mm512_test_epi8_mask(s_r, s_r) & _mm512_cmpge_epu8_mask(r_r, t2);
+
+    __m512i res = _mm512_loadu_si512(dst + x);
+    res = _mm512_mask_blend_epi8(w_l, res,
+                                 cooled_avx512(src, decay_r, p, x - lanes));
+    res = _mm512_mask_blend_epi8(w_m, res, cooled_avx512(src, decay_r, p, x));
+    res = _mm512_mask_blend_epi8(w_r, res,
+                                 cooled_avx512(src, decay_r, p, x + lanes));
+    _mm512_storeu_si512(dst + x, res);
+  }
+  gather_span(dst, src, decay_r, dir_r, p, x, n, false);
+}
+
+AVX512_TARGET static void pull_row_avx512(uint8_t *dst, const uint8_t *old,
+                                          const uint8_t *src,
+                                          const uint8_t *decay_r,
+                                          const uint8_t *dir_r,
+                                          const RowParams *p) {
+  const __m512i t_left = _mm512_set1_epi8((char)PULL_T_LEFT);
+  const __m512i t_mid = _mm512_set1_epi8((char)PULL_T_MID);
+  const __m512i t_right = _mm512_set1_epi8((char)PULL_T_RIGHT);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, lanes, false);
+  for (; x + 64 + lanes <= n; x += 64) {
+    __m512i r = _mm512_loadu_si512(dir_r + x);
+    __m512i v = _mm512_loadu_si512(src + x - lanes);
+    v = _mm512_mask_blend_epi8(_mm512_cmpge_epu8_mask(r, t_mid), v,
+                               _mm512_loadu_si512(src + x));
+    v = _mm512_mask_blend_epi8(_mm512_cmpge_epu8_mask(r, t_right), v,
+                               _mm512_loadu_si512(src + x + lanes));
+    v = _mm512_mask_blend_epi8(_mm512_testn_epi8_mask(v, v), v,
+                               _mm512_loadu_si512(src + x));
+    v = _mm512_mask_blend_epi8(_mm512_cmpge_epu8_mask(r, t_left),
+                               _mm512_loadu_si512(old + x),
+                               _mm512_subs_epu8(v, decay_avx512(decay_r, p, x)));
+    _mm512_storeu_si512(dst + x, v);
+  }
+  pull_span(dst, old, src, decay_r, dir_r, p, x, n, false);
+}
+
+AVX512_TARGET static inline __m512i widen_avx512(const uint8_t *r, int i) {
+  return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(r + i)));
+}
+
+AVX512_TARGET static inline __m512i decay16_avx512(const uint8_t *decay_r,
+                                                   const RowParams *p, int i) {
+  return _mm512_mulhi_epu16(_mm512_slli_epi16(widen_avx512(decay_r, i), 8),
+                            _mm512_set1_epi16((short)p->levels));
+}
+
+AVX512_TARGET static inline __m512i cooled16_avx512(const uint16_t *src,
+                                                    const uint8_t *decay_r,
+                                                    const RowParams *p, int i) {
+  return _mm512_subs_epu16(_mm512_loadu_si512(src + i),
+                           decay16_avx512(decay_r, p, i));
+}
+
+AVX512_TARGET static void propagate_row16_avx512(uint16_t *dst,
+                                                 const uint16_t *src,
+                                                 const uint8_t *decay_r,
+                                                 const uint8_t *dir_r,
+                                                 const RowParams *p) {
+  const __m512i t1 = _mm512_set1_epi16(DIR_T1);
+  const __m512i t2 = _mm512_set1_epi16(DIR_T2);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  gather_span(dst, src, decay_r, dir_r, p, 0, lanes, true);
+  for (; x + 32 + lanes <= n; x += 32) {
+    __m512i s_l = _mm512_loadu_si512(src + x - lanes);
+    __m512i s_m = _mm512_loadu_si512(src + x);
+    __m512i s_r = _mm512_loadu_si512(src + x + lanes);
+    __m512i r_l = widen_avx512(dir_r, x - lanes);
+    __m512i r_m = widen_avx512(dir_r, x);
+    __m512i r_r = widen_avx512(dir_r, x + lanes);
+
+    __mmask32 w_l = _mm512_test_epi16_mask(s_l, s_l) &
+                    ~_mm512_cmpge_epu16_mask(r_l, t1);
+    __mmask32 w_m = ~_mm512_test_epi16_mask(s_m, s_m) |
+                    (_mm512_cmpge_epu16_mask(r_m, t1) &
+                     ~_mm512_cmpge_epu16_mask(r_m, t2));
+    __mmask32 w_r =
+        _mm512_test_epi16_mask(s_r, s_r) & _mm512_cmpge_epu16_mask(r_r, t2);
+
+    __m512i res = _mm512_loadu_si512(dst + x);
+    res = _mm512_mask_blend_epi16(w_l, res,
+                                  cooled16_avx512(src, decay_r, p, x - lanes));
+    res =
+        _mm512_mask_blend_epi16(w_m, res, cooled16_avx512(src, decay_r, p, x));
+    res = _mm512_mask_blend_epi16(w_r, res,
+                                  cooled16_avx512(src, decay_r, p, x + lanes));
+    _mm512_storeu_si512(dst + x, res);
+  }
+  gather_span(dst, src, decay_r, dir_r, p, x, n, true);
+}
+
+AVX512_TARGET static void pull_row16_avx512(uint16_t *dst, const uint16_t *old,
+                                            const uint16_t *src,
+                                            const uint8_t *decay_r,
+                                            const uint8_t *dir_r,
+                                            const RowParams *p) {
+  const __m512i t_left = _mm512_set1_epi16(PULL_T_LEFT);
+  const __m512i t_mid = _mm512_set1_epi16(PULL_T_MID);
+  const __m512i t_right = _mm512_set1_epi16(PULL_T_RIGHT);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, lanes, true);
+  for (; x + 32 + lanes <= n; x += 32) {
+    __m512i r = widen_avx512(dir_r, x);
+    __m512i v = _mm512_loadu_si512(src + x - lanes);
+    v = _mm512_mask_blend_epi16(_mm512_cmpge_epu16_mask(r, t_mid), v,
+                                _mm512_loadu_si512(src + x));
+    v = _mm512_mask_blend_epi16(_mm512_cmpge_epu16_mask(r, t_right), v,
+                                _mm512_loadu_si512(src + x + lanes));
+    v = _mm512_mask_blend_epi16(_mm512_testn_epi16_mask(v, v), v,
+                                _mm512_loadu_si512(src + x));
+    v = _mm512_mask_blend_epi16(
+        _mm512_cmpge_epu16_mask(r, t_left), _mm512_loadu_si512(old + x),
+        _mm512_subs_epu16(v, decay16_avx512(decay_r, p, x)));
+    _mm512_storeu_si512(dst + x, v);
+  }
+  pull_span(dst, old, src, decay_r, dir_r, p, x, n, true);
+}
+
+#endif // FIRE_X86
+
+#ifdef FIRE_NEON
+
+static inline uint8x16_t decay_neon(const uint8_t *decay_r, const RowParams *p,
+                                    int i) {
+  uint8x16_t r = vld1q_u8(decay_r + i);
+  uint8x16_t d = vdupq_n_u8(0);
+  for (int k = 1; k < p->levels; k++)
+    d = vsubq_u8(d, vcgeq_u8(r, vdupq_n_u8(p->decay_t[k])));
+  return d;
+}
+
+static inline uint8x16_t cooled_neon(const uint8_t *src,
+                                     const uint8_t *decay_r,
+                                     const RowParams *p, int i) {
+  return vqsubq_u8(vld1q_u8(src + i), decay_neon(decay_r, p, i));
+}
+
+static void propagate_row_neon(uint8_t *dst, const uint8_t *src,
+                               const uint8_t *decay_r, const uint8_t *dir_r,
+                               const RowParams *p) {
+  const uint8x16_t t1 = vdupq_n_u8(DIR_T1);
+  const uint8x16_t t2 = vdupq_n_u8(DIR_T2);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  gather_span(dst, src, decay_r, dir_r, p, 0, lanes, false);
+  for (; x + 16 + lanes <= n; x += 16) {
+    uint8x16_t s_l = vld1q_u8(src + x - lanes);
+    uint8x16_t s_m = vld1q_u8(src + x);
+    uint8x16_t s_r = vld1q_u8(src + x + lanes);
+    uint8x16_t r_l = vld1q_u8(dir_r + x - lanes);
+    uint8x16_t r_m = vld1q_u8(dir_r + x);
+    uint8x16_t r_r = vld1q_u8(dir_r + x + lanes);
+
+    uint8x16_t w_l = vbicq_u8(vtstq_u8(s_l, s_l), vcgeq_u8(r_l, t1));
+    uint8x16_t w_m = vorrq_u8(vmvnq_u8(vtstq_u8(s_m, s_m)),
+                              vbicq_u8(vcgeq_u8(r_m, t1), vcgeq_u8(r_m, t2)));
+    uint8x16_t w_r = vandq_u8(vtstq_u8(s_r, s_r), vcgeq_u8(r_r, t2));
+
+    uint8x16_t res = vld1q_u8(dst + x);
+    res = vbslq_u8(w_l, cooled_neon(src, decay_r, p, x - lanes), res);
+    res = vbslq_u8(w_m, cooled_neon(src, decay_r, p, x), res);
+    res = vbslq_u8(w_r, cooled_neon(src, decay_r, p, x + lanes), res);
+    vst1q_u8(dst + x, res);
+  }
+  gather_span(dst, src, decay_r, dir_r, p, x, n, false);
+}
+
+static void pull_row_neon(uint8_t *dst, const uint8_t *old,
+                          const uint8_t *src, const uint8_t *decay_r,
+                          const uint8_t *dir_r, const RowParams *p) {
+  const uint8x16_t t_left = vdupq_n_u8(PULL_T_LEFT);
+  const uint8x16_t t_mid = vdupq_n_u8(PULL_T_MID);
+  const uint8x16_t t_right = vdupq_n_u8(PULL_T_RIGHT);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, lanes, false);
+  for (; x + 16 + lanes <= n; x += 16) {
+    uint8x16_t r = vld1q_u8(dir_r + x);
+    uint8x16_t v = vld1q_u8(src + x - lanes);
+    v = vbslq_u8(vcgeq_u8(r, t_mid), vld1q_u8(src + x), v);
+    v = vbslq_u8(vcgeq_u8(r, t_right), vld1q_u8(src + x + lanes), v);
+    v = vbslq_u8(vceqq_u8(v, vdupq_n_u8(0)), vld1q_u8(src + x), v);
+    v = vbslq_u8(vcgeq_u8(r, t_left), vqsubq_u8(v, decay_neon(decay_r, p, x)),
+                 vld1q_u8(old + x));
+    vst1q_u8(dst + x, v);
+  }
+  pull_span(dst, old, src, decay_r, dir_r, p, x, n, false);
+}
+
+// Decay for 8 cells of 16-bit heat starting at i
+static inline uint16x8_t decay16_neon(const uint8_t *decay_r,
+                                      const RowParams *p, int i) {
+  uint16x8_t r = vmovl_u8(vld1_u8(decay_r + i));
+  uint16x4_t levels = vdup_n_u16((uint16_t)p->levels);
+  return vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(r), levels), 8),
+                      vshrn_n_u32(vmull_u16(vget_high_u16(r), levels), 8));
+}
+
+static inline uint16x8_t cooled16_neon(const uint16_t *src,
+                                       const uint8_t *decay_r,
+                                       const RowParams *p, int i) {
+  return vqsubq_u16(vld1q_u16(src + i), decay16_neon(decay_r, p, i));
+}
+
+static void propagate_row16_neon(uint16_t *dst, const uint16_t *src,
+                                 const uint8_t *decay_r, const uint8_t *dir_r,
+                                 const RowParams *p) {
+  const uint16x8_t t1 = vdupq_n_u16(DIR_T1);
+  const uint16x8_t t2 = vdupq_n_u16(DIR_T2);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  gather_span(dst, src, decay_r, dir_r, p, 0, lanes, true);
+  for (; x + 8 + lanes <= n; x += 8) {
+    uint16x8_t s_l = vld1q_u16(src + x - lanes);
+    uint16x8_t s_m = vld1q_u16(src + x);
+    uint16x8_t s_r = vld1q_u16(src + x + lanes);
+    uint16x8_t r_l = vmovl_u8(vld1_u8(dir_r + x - lanes));
+    uint16x8_t r_m = vmovl_u8(vld1_u8(dir_r + x));
+    uint16x8_t r_r = vmovl_u8(vld1_u8(dir_r + x + lanes));
+
+    uint16x8_t w_l = vbicq_u16(vtstq_u16(s_l, s_l), vcgeq_u16(r_l, t1));
+    uint16x8_t w_m =
+        vorrq_u16(vmvnq_u16(vtstq_u16(s_m, s_m)),
+                  vbicq_u16(vcgeq_u16(r_m, t1), vcgeq_u16(r_m, t2)));
+    uint16x8_t w_r = vandq_u16(vtstq_u16(s_r, s_r), vcgeq_u16(r_r, t2));
+
+    uint16x8_t res = vld1q_u16(dst + x);
+    res = vbslq_u16(w_l, cooled16_neon(src, decay_r, p, x - lanes), res);
+    res = vbslq_u16(w_m, cooled16_neon(src, decay_r, p, x), res);
+    res = vbslq_u16(w_r, cooled16_neon(src, decay_r, p, x + lanes), res);
+    vst1q_u16(dst + x, res);
+  }
+  gather_span(dst, src, decay_r, dir_r, p, x, n, true);
+}
+
+static void pull_row16_neon(uint16_t *dst, const uint16_t *old,
+                            const uint16_t *src, const uint8_t *decay_r,
+                            const uint8_t *dir_r, const RowParams *p) {
+  const uint16x8_t t_left = vdupq_n_u16(PULL_T_LEFT);
+  const uint16x8_t t_mid = vdupq_n_u16(PULL_T_MID);
+  const uint16x8_t t_right = vdupq_n_u16(PULL_T_RIGHT);
+  int n = p->n, lanes = p->lanes;
+  int x = lanes;
+  pull_span(dst, old, src, decay_r, dir_r, p, 0, lanes, true);
+  for (; x + 8 + lanes <= n; x += 8) {
+    uint16x8_t r = vmovl_u8(vld1_u8(dir_r + x));
+    uint16x8_t v = vld1q_u16(src + x - lanes);
+    v = vbslq_u16(vcgeq_u16(r, t_mid), vld1q_u16(src + x), v);
+    v = vbslq_u16(vcgeq_u16(r, t_right), vld1q_u16(src + x + lanes), v);
+    v = vbslq_u16(vceqq_u16(v, vdupq_n_u16(0)), vld1q_u16(src + x), v);
+    v = vbslq_u16(vcgeq_u16(r, t_left),
+                  vqsubq_u16(v, decay16_neon(decay_r, p, x)),
+                  vld1q_u16(old + x));
+    vst1q_u16(dst + x, v);
+  }
+  pull_span(dst, old, src, decay_r, dir_r, p, x, n, true);
+}
+
+#endif // FIRE_NEON
+
+static const PropagateFn propagate_kernels[DOOMFIRE_KERNEL_COUNT] = {
+    propagate_row_scalar,
+#ifdef FIRE_X86
+    propagate_row_sse2,   propagate_row_avx2, propagate_row_avx512,
+#else
+    NULL,                 NULL,               NULL,
+#endif
+#ifdef FIRE_NEON
+    propagate_row_neon,
+#else
+    NULL,
+#endif
+};
+
+static const PullFn pull_kernels[DOOMFIRE_KERNEL_COUNT] = {
+    pull_row_scalar,
+#ifdef FIRE_X86
+    pull_row_sse2,   pull_row_avx2, pull_row_avx512,
+#else
+    NULL,            NULL,          NULL,
+#endif
+#ifdef FIRE_NEON
+    pull_row_neon,
+#else
+    NULL,
+#endif
+};
+
+static const PropagateFn16 propagate16_kernels[DOOMFIRE_KERNEL_COUNT] = {
+    propagate_row16_scalar,
+#ifdef FIRE_X86
+    propagate_row16_sse2,   propagate_row16_avx2, propagate_row16_avx512,
+#else
+    NULL,                   NULL,                 NULL,
+#endif
+#ifdef FIRE_NEON
+    propagate_row16_neon,
+#else
+    NULL,
+#endif
+};
+
+static const PullFn16 pull16_kernels[DOOMFIRE_KERNEL_COUNT] = {
+    pull_row16_scalar,
+#ifdef FIRE_X86
+    pull_row16_sse2,   pull_row16_avx2, pull_row16_avx512,
+#else
+    NULL,              NULL,            NULL,
+#endif
+#ifdef FIRE_NEON
+    pull_row16_neon,
+#else
+    NULL,
+#endif
+};
+
+// Whether the running CPU can execute kernel `k` (cpuid on x86). The build
+// host may differ from the run host, so this is decided at runtime.
+bool doomfire_kernel_supported(DoomFireKernel k) {
+  if (k < 0 || k >= DOOMFIRE_KERNEL_COUNT || !propagate_kernels[k])
+    return false;
+#ifdef FIRE_X86
+  __builtin_cpu_init();
+  if (k == DOOMFIRE_KERNEL_AVX2)
+    return __builtin_cpu_supports("avx2");
+  if (k == DOOMFIRE_KERNEL_AVX512)
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+#endif
+  return true;
+}
+
+DoomFireKernel doomfire_kernel_best(void) {
+  for (int k = DOOMFIRE_KERNEL_COUNT - 1; k > DOOMFIRE_KERNEL_SCALAR; k--)
+    if (doomfire_kernel_supported(k))
+      return k;
+  return DOOMFIRE_KERNEL_SCALAR;
+}
+
+// --- Instance ---
+
+struct DoomFire {
+  DoomFireConfig cfg; // as in use: kernel and threads resolved
+  RowParams params;
+  PropagateFn propagate_row;
+  PullFn pull_row;
+  PropagateFn16 propagate_row16;
+  PullFn16 pull_row16;
+  size_t row_bytes; // heat bytes per row: params.n cells of 1 or 2 bytes
+  FirePool pool;
+
+  // Heat buffers; pull swaps them every frame, front holds the latest frame
+  uint8_t *front, *back;
+
+  // Active region: which rows hold any heat, and the topmost such row. The
+  // masks belong to front and back respectively; a cold row only produces a
+  // cold row above it, so rows above the ceiling need no work.
+  uint8_t *row_hot, *row_hot_next;
+  int ceiling;
+  atomic_int skipped; // cells not run through a kernel this step
+  int last_skipped;
+
+  // Every row of every frame draws from its own RNG stream, so rows can be
+  // generated independently of each other
+  uint64_t frame;
+  uint8_t *rand_bytes; // 2 bytes per cell of a row per worker
+  uint8_t *band_edges; // snapshot of the row below each band
+
+  DoomFireStats stats;
+  DoomFireRowHook row_hook;
+  void *row_hook_ctx;
+};
+
+void doomfire_config_default(DoomFireConfig *cfg, int width, int height) {
+  *cfg = (DoomFireConfig){.width = width,
+                          .height = height,
+                          .stride = width,
+                          .instances = 1,
+                          .cooling_max = 3,
+                          .spark_chance = 60,
+                          .edge = DOOMFIRE_EDGE_CLIP,
+                          .propagation = DOOMFIRE_PUSH,
+                          .rng = FIRE_RNG_HASH,
+                          .threads = 1,
+                          .kernel = DOOMFIRE_KERNEL_AUTO};
+}
+
+// Rows are split into more bands than threads so that a slow thread does not
+// hold up the frame.
+static int band_count(const DoomFire *f, int rows) {
+  int n = f->pool.size == 1 ? 1 : f->pool.size * 4;
+  return n < rows ? n : rows;
+}
+
+DoomFire *doomfire_create(const DoomFireConfig *cfg) {
+  int cell = cfg->heat16 ? 2 : 1;
+  if (cfg->width < 1 || cfg->height < 2 || cfg->instances < 1 ||
+      cfg->stride < (ptrdiff_t)cfg->width * cfg->instances * cell ||
+      cfg->stride % cell || !cfg->heat || (uintptr_t)cfg->heat % cell ||
+      (uintptr_t)cfg->back % cell || cfg->cooling_max < 0 ||
+      cfg->cooling_max > (cfg->heat16 ? 65534 : 255) ||
+      (cfg->propagation == DOOMFIRE_PULL && !cfg->back))
+    return NULL;
+  DoomFireKernel kernel =
+      cfg->kernel == DOOMFIRE_KERNEL_AUTO ? doomfire_kernel_best() : cfg->kernel;
+  if (!doomfire_kernel_supported(kernel))
+    return NULL;
+
+  DoomFire *f = calloc(1, sizeof(*f));
+  if (!f)
+    return NULL;
+  f->cfg = *cfg;
+  f->cfg.kernel = kernel;
+  f->propagate_row = propagate_kernels[kernel];
+  f->pull_row = pull_kernels[kernel];
+  f->propagate_row16 = propagate16_kernels[kernel];
+  f->pull_row16 = pull16_kernels[kernel];
+
+  f->params.w = cfg->width;
+  f->params.lanes = cfg->instances;
+  f->params.n = cfg->width * cfg->instances;
+  f->params.levels = cfg->cooling_max + 1;
+  f->params.edge = cfg->edge;
+  f->row_bytes = (size_t)f->params.n * cell;
+  if (!cfg->heat16)
+    for (int k = 1; k < f->params.levels; k++)
+      f->params.decay_t[k] = range_threshold(k, f->params.levels);
+
+  pool_start(&f->pool, cfg->threads > 1 ? cfg->threads : 1);
+  f->cfg.threads = f->pool.size;
+
+  size_t n = f->params.n;
+  f->row_hot = calloc(cfg->height, 1);
+  f->row_hot_next = calloc(cfg->height, 1);
+  f->rand_bytes = malloc(2 * n * f->pool.size);
+  f->band_edges = malloc(f->row_bytes * (f->pool.size * 4 + 1));
+  if (!f->row_hot || !f->row_hot_next || !f->rand_bytes || !f->band_edges) {
+    doomfire_destroy(f);
+    return NULL;
+  }
+  doomfire_reset(f);
+  return f;
+}
+
+void doomfire_destroy(DoomFire *f) {
+  if (!f)
+    return;
+  pool_stop(&f->pool);
+  free(f->row_hot);
+  free(f->row_hot_next);
+  free(f->rand_bytes);
+  free(f->band_edges);
+  free(f);
+}
+
+// Put out the fire: all cells and masks cold, RNG streams back to frame 0
+void doomfire_reset(DoomFire *f) {
+  size_t bytes = (size_t)f->cfg.stride * f->cfg.height;
+  f->front = f->cfg.heat;
+  f->back = f->cfg.back;
+  memset(f->front, 0, bytes);
+  if (f->back)
+    memset(f->back, 0, bytes);
+  memset(f->row_hot, 0, f->cfg.height);
+  memset(f->row_hot_next, 0, f->cfg.height);
+  f->ceiling = f->cfg.height;
+  f->frame = 0;
+}
+
+const uint8_t *doomfire_heat(const DoomFire *f) { return f->front; }
+const uint16_t *doomfire_heat16(const DoomFire *f) {
+  return (const uint16_t *)f->front;
+}
+const uint8_t *doomfire_row_hot(const DoomFire *f) { return f->row_hot; }
+
+void doomfire_copy_instance(const DoomFire *f, int instance, uint8_t *out,
+                            ptrdiff_t out_stride) {
+  int lanes = f->params.lanes;
+  bool wide = f->cfg.heat16;
+  for (int y = 0; y < f->cfg.height; y++) {
+    const uint8_t *row = f->front + (ptrdiff_t)y * f->cfg.stride;
+    uint8_t *dst = out + (ptrdiff_t)y * out_stride;
+    for (int x = 0; x < f->cfg.width; x++) {
+      int i = x * lanes + instance;
+      dst[x] =
+          wide ? doomfire_heat16_index(((const uint16_t *)row)[i]) : row[i];
+    }
+  }
+}
+int doomfire_ceiling(const DoomFire *f) { return f->ceiling; }
+int doomfire_last_skipped(const DoomFire *f) { return f->last_skipped; }
+const DoomFireStats *doomfire_stats(const DoomFire *f) { return &f->stats; }
+const DoomFireConfig *doomfire_config(const DoomFire *f) { return &f->cfg; }
+
+void doomfire_parallel(DoomFire *f, DoomFireTask fn, void *arg, int tasks) {
+  pool_run(&f->pool, fn, arg, tasks);
+}
+
+void doomfire_set_row_hook(DoomFire *f, DoomFireRowHook hook, void *ctx) {
+  f->row_hook = hook;
+  f->row_hook_ctx = ctx;
+}
+
+// --- Simulation ---
+
+static inline uint8_t *row_at(const DoomFire *f, const uint8_t *buf, int y) {
+  return (uint8_t *)buf + (ptrdiff_t)y * f->cfg.stride;
+}
+
+static inline void touch(const DoomFire *f, const uint8_t *row, bool write) {
+  if (f->row_hook)
+    f->row_hook(f->row_hook_ctx, row, write);
+}
+
+static bool row_lit(const uint8_t *row, int w) {
+  uint64_t acc = 0;
+  int x = 0;
+  for (; x + 8 <= w; x += 8) {
+    uint64_t v;
+    memcpy(&v, row + x, 8);
+    acc |= v;
+  }
+  for (; x < w; x++)
+    acc |= row[x];
+  return acc != 0;
+}
+
+// Fill `out` with the random bytes used by row `y` of `frame`, two per byte
+static void row_random(const DoomFire *f, uint8_t *out, int y,
+                       uint64_t frame) {
+  FireRng rng;
+  fire_rng_seed(&rng, f->cfg.rng, f->cfg.seed, (frame << 32) | (uint32_t)y);
+  fire_rng_fill(&rng, out, 2 * f->params.n);
+}
+
+// One propagation step of a single row: frame `frame` is written to dst from
+// the previous frame in src. For push both are the same buffer. Masks follow
+// their buffers; for push src_hot and dst_hot may be the same array.
+typedef struct {
+  uint8_t *dst;
+  const uint8_t *src;
+  uint8_t *dst_hot;
+  const uint8_t *src_hot;
+  uint64_t frame;
+} StepTarget;
+
+// Step row y, reading the row below from `below`. Row y comes out cold when
+// the row below is cold (and, for pull, when row y itself is cold, since pull
+// may keep old values); such rows skip the RNG and the kernel and are cleared
+// only if the destination still holds heat. Returns the cells skipped.
+static int step_row(const DoomFire *f, const StepTarget *st, int y,
+                    const uint8_t *below, uint8_t *rnd) {
+  int n = f->params.n;
+  size_t bytes = f->row_bytes;
+  bool pull = f->cfg.propagation == DOOMFIRE_PULL;
+  uint8_t *dst = row_at(f, st->dst, y);
+  const uint8_t *old = row_at(f, st->src, y);
+
+  if (!st->src_hot[y + 1] && (!pull || !st->src_hot[y])) {
+    if (pull ? st->dst_hot[y] : st->src_hot[y]) {
+      memset(dst, 0, bytes);
+      touch(f, dst, true);
+    }
+    st->dst_hot[y] = 0;
+    return n;
+  }
+
+  touch(f, below, false);
+  touch(f, old, false);
+  touch(f, dst, true);
+  row_random(f, rnd, y, st->frame);
+  if (f->cfg.heat16 && pull)
+    f->pull_row16((uint16_t *)dst, (const uint16_t *)old,
+                  (const uint16_t *)below, rnd, rnd + n, &f->params);
+  else if (f->cfg.heat16)
+    f->propagate_row16((uint16_t *)dst, (const uint16_t *)below, rnd, rnd + n,
+                       &f->params);
+  else if (pull)
+    f->pull_row(dst, old, below, rnd, rnd + n, &f->params);
+  else
+    f->propagate_row(dst, below, rnd, rnd + n, &f->params);
+  st->dst_hot[y] = row_lit(dst, bytes);
+  return 0;
+}
+
+// Ignite the bottom row of `row` for `frame`. 16-bit heat uses the same
+// levels scaled by 257, so 255 maps to 65535.
+static void seed_bottom(const DoomFire *f, uint8_t *row, uint64_t frame,
+                        uint8_t *rnd) {
+  int n = f->params.n;
+  bool wide = f->cfg.heat16;
+  int unit = wide ? 257 : 1;
+  row_random(f, rnd, f->cfg.height - 1, frame);
+  const uint8_t *spark = rnd;
+  const uint8_t *heat = rnd + n;
+  for (int x = 0; x < n; x++) {
+    // Randomly ignite
+    if (spark[x] < f->cfg.spark_chance * 256 / 100) {
+      // High intensity with some variation
+      cell_set(row, x, (255 - fire_rng_range(heat[x], 50)) * unit, wide);
+    } else {
+      // Decay the source slightly so it's not a solid bar
+      int v = cell_get(row, x, wide);
+      if (v > 10 * unit)
+        cell_set(row, x, v - 5 * unit, wide);
+    }
+  }
+  touch(f, row, true);
+}
+
+static void update_ceiling(DoomFire *f) {
+  f->ceiling = 0;
+  while (f->ceiling < f->cfg.height && !f->row_hot[f->ceiling])
+    f->ceiling++;
+}
+
+typedef struct {
+  DoomFire *fire;
+  StepTarget target;
+  int first; // first propagated row
+  int bands;
+} BandPlan;
+
+// Propagate one horizontal band of rows. A band only reads the row below it;
+// for push the last of those belongs to the next band, so it comes from the
+// snapshot taken before the bands were started.
+static void propagate_band(int band, int worker, void *arg) {
+  const BandPlan *plan = arg;
+  DoomFire *f = plan->fire;
+  int n = f->params.n;
+  size_t bytes = f->row_bytes;
+  int rows = f->cfg.height - 1 - plan->first;
+  int y0 = plan->first + (int)((int64_t)band * rows / plan->bands);
+  int y1 = plan->first + (int)((int64_t)(band + 1) * rows / plan->bands);
+  uint8_t *rnd = f->rand_bytes + (size_t)2 * n * worker;
+  int skipped = 0;
+
+  for (int y = y0; y < y1; y++) {
+    const uint8_t *below = row_at(f, plan->target.src, y + 1);
+    if (f->cfg.propagation == DOOMFIRE_PUSH && y + 1 == y1 &&
+        band + 1 < plan->bands)
+      below = &f->band_edges[band * bytes];
+    skipped += step_row(f, &plan->target, y, below, rnd);
+  }
+  if (skipped)
+    atomic_fetch_add(&f->skipped, skipped);
+}
+
+// The core fire algorithm
+void doomfire_step(DoomFire *f) {
+  int n = f->params.n, h = f->cfg.height;
+
+  // 1. Seed the bottom row
+  uint8_t *bottom = row_at(f, f->front, h - 1);
+  seed_bottom(f, bottom, f->frame, f->rand_bytes);
+  f->row_hot[h - 1] = f->row_hot_next[h - 1] = row_lit(bottom, f->row_bytes);
+  if (f->row_hot[h - 1] && f->ceiling > h - 1)
+    f->ceiling = h - 1;
+
+  // 2. Propagate up. Nothing above the row under the ceiling can catch fire
+  // this frame, so only the rows from there down are split into bands. Pull
+  // reads this frame from the front buffer and writes the next into the back.
+  bool pull = f->cfg.propagation == DOOMFIRE_PULL;
+  BandPlan plan = {
+      .fire = f,
+      .target = {.dst = pull ? f->back : f->front,
+                 .src = f->front,
+                 .dst_hot = f->row_hot_next,
+                 .src_hot = f->row_hot,
+                 .frame = f->frame},
+      .first = f->ceiling > 0 ? f->ceiling - 1 : 0,
+  };
+  if (plan.first > h - 1)
+    plan.first = h - 1;
+  atomic_store(&f->skipped, 0);
+  for (int y = 0; y < plan.first; y++)
+    step_row(f, &plan.target, y, NULL, NULL);
+  plan.bands = band_count(f, h - 1 - plan.first);
+
+  if (pull) {
+    pool_run(&f->pool, propagate_band, &plan, plan.bands);
+    memcpy(row_at(f, f->back, h - 1), bottom, f->row_bytes);
+    uint8_t *t = f->front;
+    f->front = f->back;
+    f->back = t;
+  } else {
+    int rows = h - 1 - plan.first;
+    for (int b = 0; b + 1 < plan.bands; b++) {
+      int y1 = plan.first + (int)((int64_t)(b + 1) * rows / plan.bands);
+      memcpy(&f->band_edges[b * f->row_bytes], row_at(f, f->front, y1),
+             f->row_bytes);
+    }
+    pool_run(&f->pool, propagate_band, &plan, plan.bands);
+  }
+
+  uint8_t *t = f->row_hot;
+  f->row_hot = f->row_hot_next;
+  f->row_hot_next = t;
+  update_ceiling(f);
+
+  f->last_skipped = atomic_load(&f->skipped) + plan.first * n;
+  f->stats.frames++;
+  f->stats.cells += (uint64_t)n * h;
+  f->stats.cells_skipped += f->last_skipped;
+  f->frame++;
+}
+
+// --- Temporal Blocking ---
+//
+// For grids far larger than the cache (headless texture runs at 8192x4096
+// and up) the row sweep above streams every active row through DRAM once per
+// frame. doomfire_step_n() instead advances several frames in one pass: step
+// (frame t, row y) runs in wavefront order of y + 2t. That order keeps every
+// dependency of the sweep (row y after row y-1 of the same frame, and after
+// rows y and y+1 of the frame before) while only keeping about 2 rows per
+// frame in flight, so each row is reused from cache for all frames of the
+// block. Pairs on the same wavefront are independent and run on the pool.
+//
+// Each (frame, row) draws from its own RNG stream, so the result is bit for
+// bit the same as calling doomfire_step() once per frame.
+
+#define BLOCK_CACHE_BYTES (512 * 1024) // working set budget, about half an L2
+#define BLOCK_MAX_FRAMES 32
+
+// Frames per block that keep the wavefront window inside the cache budget
+int doomfire_block_depth(const DoomFire *f) {
+  int bufs = f->cfg.propagation == DOOMFIRE_PULL ? 2 : 1;
+  int depth = BLOCK_CACHE_BYTES / (2 * bufs * (int)f->row_bytes + 1);
+  if (depth < 2)
+    depth = 2;
+  return depth < BLOCK_MAX_FRAMES ? depth : BLOCK_MAX_FRAMES;
+}
+
+typedef struct {
+  DoomFire *fire;
+  StepTarget targets[BLOCK_MAX_FRAMES];
+  int key;    // current wavefront: y + 2t
+  int frames; // frames in the block
+  int t0;     // first frame index on this wavefront
+} Wavefront;
+
+static void wavefront_step(int task, int worker, void *arg) {
+  Wavefront *wf = arg;
+  DoomFire *f = wf->fire;
+  int n = f->params.n;
+  int t = wf->t0 + task;
+  int y = wf->key - 2 * t;
+  const StepTarget *st = &wf->targets[t];
+  uint8_t *rnd = f->rand_bytes + (size_t)2 * n * worker;
+  int last = f->cfg.height - 1;
+  bool pull = f->cfg.propagation == DOOMFIRE_PULL;
+
+  // The bottom row of frame t is seeded right before its first reader, and
+  // for pull carried over to the buffer the frame writes.
+  if (y == last - 1) {
+    uint8_t *bottom = row_at(f, st->src, last);
+    seed_bottom(f, bottom, st->frame, rnd);
+    ((uint8_t *)st->src_hot)[last] = row_lit(bottom, f->row_bytes);
+  }
+  int skipped = step_row(f, st, y, row_at(f, st->src, y + 1), rnd);
+  if (pull && y == last - 1) {
+    memcpy(row_at(f, st->dst, last), row_at(f, st->src, last), f->row_bytes);
+    st->dst_hot[last] = st->src_hot[last];
+  }
+  if (skipped)
+    atomic_fetch_add(&f->skipped, skipped);
+}
+
+// Advance the simulation by `frames` frames using temporal blocking
+void doomfire_step_n(DoomFire *f, int frames) {
+  int n = f->params.n, h = f->cfg.height;
+  int rows = h - 1;
+  bool pull = f->cfg.propagation == DOOMFIRE_PULL;
+  uint8_t *buf[2] = {f->front, f->back};
+  uint8_t *hot[2] = {f->row_hot, f->row_hot_next};
+  int depth = doomfire_block_depth(f);
+
+  for (int done = 0; done < frames;) {
+    Wavefront wf = {.fire = f, .frames = frames - done};
+    if (wf.frames > depth)
+      wf.frames = depth;
+
+    for (int t = 0; t < wf.frames; t++) {
+      // Push steps in place with one mask per row; pull alternates buffers
+      int s = pull ? (done + t) & 1 : 0;
+      int d = pull ? s ^ 1 : 0;
+      wf.targets[t] = (StepTarget){.dst = buf[d],
+                                   .src = buf[s],
+                                   .dst_hot = hot[d],
+                                   .src_hot = hot[s],
+                                   .frame = f->frame + t};
+    }
+
+    atomic_store(&f->skipped, 0);
+    int last_key = rows - 1 + 2 * (wf.frames - 1);
+    for (wf.key = 0; wf.key <= last_key; wf.key++) {
+      // Frames whose row key - 2t lies in [0, rows)
+      int t_lo = wf.key - (rows - 1) > 0 ? (wf.key - (rows - 1) + 1) / 2 : 0;
+      int t_hi = wf.key / 2;
+      if (t_hi > wf.frames - 1)
+        t_hi = wf.frames - 1;
+      wf.t0 = t_lo;
+      pool_run(&f->pool, wavefront_step, &wf, t_hi - t_lo + 1);
+    }
+
+    f->last_skipped = atomic_load(&f->skipped);
+    f->stats.frames += wf.frames;
+    f->stats.cells += (uint64_t)n * h * wf.frames;
+    f->stats.cells_skipped += f->last_skipped;
+    f->frame += wf.frames;
+    done += wf.frames;
+  }
+
+  // Hand the front buffer and its masks back in doomfire_step()'s layout
+  int front = pull ? frames & 1 : 0;
+  f->front = buf[front];
+  f->back = buf[front ^ 1];
+  f->row_hot = hot[front];
+  f->row_hot_next = hot[front ^ 1];
+  update_ceiling(f);
+}
+
+// --- Palette ---
+
+void doomfire_palette_rgb(DoomFireRGB out[256]) {
+  // Black -> Red -> Orange -> Yellow -> White
+  for (int i = 0; i < 256; i++) {
+    DoomFireRGB c = {0, 0, 0};
+    if (i < 64) {
+      // Black to Red
+      c.r = i * 4;
+    } else if (i < 128) {
+      // Red to Yellow
+      c.r = 255;
+      c.g = (i - 64) * 4;
+    } else if (i < 192) {
+      // Yellow to White
+      c.r = 255;
+      c.g = 255;
+      c.b = (i - 128) * 4;
+    } else {
+      // White
+      c.r = 255;
+      c.g = 255;
+      c.b = 255;
+    }
+    out[i] = c;
+  }
+}
+
+void doomfire_palette_argb(uint32_t out[256]) {
+  DoomFireRGB rgb[256];
+  doomfire_palette_rgb(rgb);
+  for (int i = 0; i < 256; i++)
+    out[i] = 0xFF000000u | (uint32_t)rgb[i].r << 16 | (uint32_t)rgb[i].g << 8 |
+             rgb[i].b;
+}
@@ -0,0 +1,149 @@
+/**
+ * doomfire.h - Shared Doom fire simulation core
+ *
+ * The fire algorithm used by fire.c, fire-gfx.c and fire-cube.c: bottom row
+ * ignition, upward propagation with random drift and cooling, and the fire
+ * palette. The simulation runs on caller-provided heat buffers (one byte per
+ * cell, or two in 16-bit mode; rows `stride` bytes apart) and carries the
+ * optimized paths:
+ * bulk RNG streams per row, SIMD kernels chosen at runtime, band-parallel
+ * threads, cold-row skipping, temporal blocking and batches of many small
+ * fires stepped in one call.
+ *
+ * Build it into a program directly:
+ *   clang -O3 -pthread app.c doomfire.c -o app
+ * or as a static library:
+ *   clang -O3 -c doomfire.c && ar rcs libdoomfire.a doomfire.o
+ */
+
+#ifndef DOOMFIRE_H
+#define DOOMFIRE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fire-rng.h"
+
+typedef struct DoomFire DoomFire;
+
+// What happens to heat that drifts past the left or right edge
+typedef enum {
+  DOOMFIRE_EDGE_CLIP = 0, // it is lost
+  DOOMFIRE_EDGE_CLAMP     // it lands on the edge column
+} DoomFireEdge;
+
+typedef enum {
+  DOOMFIRE_PUSH = 0, // classic in-place scatter to x-1, x or x+1
+  DOOMFIRE_PULL,     // gather from the previous frame, ping-pong buffers
+  DOOMFIRE_PROPAGATION_COUNT
+} DoomFirePropagation;
+
+typedef enum {
+  DOOMFIRE_KERNEL_AUTO = -1,
+  DOOMFIRE_KERNEL_SCALAR = 0,
+  DOOMFIRE_KERNEL_SSE2,
+  DOOMFIRE_KERNEL_AVX2,
+  DOOMFIRE_KERNEL_AVX512,
+  DOOMFIRE_KERNEL_NEON,
+  DOOMFIRE_KERNEL_COUNT
+} DoomFireKernel;
+
+// Batches: with instances > 1 one DoomFire steps that many independent fires
+// of the same size. Their cells are interleaved so SIMD lanes span instances:
+// cell (x, y) of instance i is heat[y * stride + x * instances + i].
+typedef struct {
+  int width, height; // of one instance
+  int instances;     // interleaved fires per buffer, 1 for a single fire
+  ptrdiff_t stride;  // bytes between rows of heat and back, >= width *
+                     // instances * bytes per cell
+  uint8_t *heat;     // height * stride bytes, owned by the caller
+  uint8_t *back;     // second buffer of the same size, required for pull
+  // 16-bit heat: cells are uint16_t holding heat * 256 plus a fraction, and
+  // cooling_max counts in 1/256 levels (768 cools like 3 in 8-bit mode, less
+  // gives taller fires that still span the whole palette)
+  bool heat16;
+  int cooling_max;  // each row cools by 0..cooling_max
+  int spark_chance; // % of bottom cells that ignite per frame
+  DoomFireEdge edge;
+  DoomFirePropagation propagation;
+  FireRngKind rng;
+  uint64_t seed;
+  int threads; // 1 runs everything on the calling thread
+  DoomFireKernel kernel;
+} DoomFireConfig;
+
+typedef struct {
+  uint64_t frames;
+  uint64_t cells;         // cells stepped over all instances, incl. skipped
+  uint64_t cells_skipped; // cold cells that needed no kernel work
+} DoomFireStats;
+
+typedef struct {
+  uint8_t r, g, b;
+} DoomFireRGB;
+
+// Called for every heat row the simulation reads or writes; for tooling
+typedef void (*DoomFireRowHook)(void *ctx, const uint8_t *row, bool write);
+
+extern const char *const doomfire_propagation_names[DOOMFIRE_PROPAGATION_COUNT];
+extern const char *const doomfire_kernel_names[DOOMFIRE_KERNEL_COUNT];
+
+// Defaults: one instance, clip edges, cooling 0..3, 60% sparks, push, hash
+// RNG, 1 thread, best kernel. Buffers stay NULL.
+void doomfire_config_default(DoomFireConfig *cfg, int width, int height);
+
+// Returns NULL when the configuration is invalid or memory runs out
+DoomFire *doomfire_create(const DoomFireConfig *cfg);
+void doomfire_destroy(DoomFire *f);
+
+// Advance one frame
+void doomfire_step(DoomFire *f);
+// Advance `frames` frames with temporal blocking; same result as stepping
+void doomfire_step_n(DoomFire *f, int frames);
+// Clear all heat and restart the RNG streams at frame 0
+void doomfire_reset(DoomFire *f);
+
+// Front buffer holding the latest frame (pull swaps heat and back)
+const uint8_t *doomfire_heat(const DoomFire *f);
+// The same buffer as 16-bit cells, for heat16 fires
+const uint16_t *doomfire_heat16(const DoomFire *f);
+// Copy one instance of a batch out of the interleaved front buffer into a
+// plain width x height image with rows `out_stride` bytes apart, one palette
+// index per cell
+void doomfire_copy_instance(const DoomFire *f, int instance, uint8_t *out,
+                            ptrdiff_t out_stride);
+// Per-row flags, nonzero when the row holds any heat (in any instance)
+const uint8_t *doomfire_row_hot(const DoomFire *f);
+// First row with any heat, height when the grid is cold
+int doomfire_ceiling(const DoomFire *f);
+// Cells skipped by the last step
+int doomfire_last_skipped(const DoomFire *f);
+const DoomFireStats *doomfire_stats(const DoomFire *f);
+const DoomFireConfig *doomfire_config(const DoomFire *f);
+// Frames per block doomfire_step_n() uses for this grid
+int doomfire_block_depth(const DoomFire *f);
+
+void doomfire_set_row_hook(DoomFire *f, DoomFireRowHook hook, void *ctx);
+
+// Run fn(task, worker, arg) for every task in [0, tasks) on the fire's worker
+// pool, the calling thread included, and wait for all. worker is in
+// [0, cfg.threads). For work between steps, such as encoding the frame.
+typedef void (*DoomFireTask)(int task, int worker, void *arg);
+void doomfire_parallel(DoomFire *f, DoomFireTask fn, void *arg, int tasks);
+
+// Whether the running CPU can execute `k`, and the best kernel it can
+bool doomfire_kernel_supported(DoomFireKernel k);
+DoomFireKernel doomfire_kernel_best(void);
+
+// Fire palette: black -> red -> orange -> yellow -> white
+void doomfire_palette_rgb(DoomFireRGB out[256]);
+// Same palette as 0xAARRGGBB with opaque alpha
+void doomfire_palette_argb(uint32_t out[256]);
+
+// Palette index of a 16-bit heat cell: its high byte
+static inline uint8_t doomfire_heat16_index(uint16_t heat) {
+  return (uint8_t)(heat >> 8);
+}
+
+#endif // DOOMFIRE_H
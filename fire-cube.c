@@ -1,12 +1,14 @@
 /**
  * fire-cube.c - 3D Fire Cube Simulation (macOS Cocoa + OpenGL)
  *
- * A standalone, single-file Cocoa application rendering the classic Doom fire
- * as a texture on a rotating 3D cube.
+ * A Cocoa application rendering the classic Doom fire as a texture on a
+ * rotating 3D cube.
+ *
+ * The simulation itself lives in the shared doomfire core (doomfire.h).
  *
  * Compile with:
- *   clang -O3 -x objective-c -framework Cocoa -framework OpenGL fire-cube.c -o
- * fire-cube
+ *   clang -O3 -pthread -framework Cocoa -framework OpenGL -x objective-c \
+ *     fire-cube.c -x c doomfire.c -o fire-cube
  */
 
 #define GL_SILENCE_DEPRECATION // Silence OpenGL deprecation warnings on macOS
@@ -15,9 +17,12 @@
 #import <OpenGL/gl.h>
 #include <math.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+#include "doomfire.h"
+
 // --- Configuration ---
 #define FIRE_WIDTH 128
 #define FIRE_HEIGHT 128
@@ -29,6 +34,7 @@
 static uint8_t fire_buffer[FIRE_WIDTH * FIRE_HEIGHT];
 static uint32_t pixel_buffer[FIRE_WIDTH * FIRE_HEIGHT]; // ARGB
 static uint32_t palette[256];
+static DoomFire *fire;
 static GLuint fire_texture;
 static float rot_x = 0.0f;
 static float rot_y = 0.0f;
@@ -36,68 +42,26 @@ static float rot_z = 0.0f;
 
 // --- Fire Algorithm ---
 
-void init_palette(void) {
-  for (int i = 0; i < 256; i++) {
-    uint8_t r = 0, g = 0, b = 0;
-    if (i < 64) {
-      r = i * 4;
-    } else if (i < 128) {
-      r = 255;
-      g = (i - 64) * 4;
-    } else if (i < 192) {
-      r = 255;
-      g = 255;
-      b = (i - 128) * 4;
-    } else {
-      r = 255;
-      g = 255;
-      b = 255;
-    }
-    // OpenGL expects RGBA or BGRA. Let's use GL_BGRA.
-    // 0xAARRGGBB
-    palette[i] = (0xFF << 24) | (r << 16) | (g << 8) | b;
+void init_fire(void) {
+  DoomFireConfig cfg;
+  doomfire_config_default(&cfg, FIRE_WIDTH, FIRE_HEIGHT);
+  cfg.heat = fire_buffer;
+  cfg.edge = DOOMFIRE_EDGE_CLAMP; // heat drifting off the side stays on screen
+  cfg.cooling_max = 2;
+  cfg.rng = FIRE_RNG_XOSHIRO;
+  cfg.seed = (uint64_t)time(NULL);
+  fire = doomfire_create(&cfg);
+  if (!fire) {
+    fprintf(stderr, "cannot create a %dx%d fire\n", FIRE_WIDTH, FIRE_HEIGHT);
+    exit(1);
   }
+  doomfire_palette_argb(palette);
 }
 
 void update_fire(void) {
-  // 1. Seed bottom row
-  int last_row = (FIRE_HEIGHT - 1) * FIRE_WIDTH;
-  for (int x = 0; x < FIRE_WIDTH; x++) {
-    if ((rand() % 100) < 60) {
-      fire_buffer[last_row + x] = 255 - (rand() % 50);
-    } else {
-      if (fire_buffer[last_row + x] > 10)
-        fire_buffer[last_row + x] -= 5;
-    }
-  }
-
-  // 2. Propagate
-  for (int y = 0; y < FIRE_HEIGHT - 1; y++) {
-    for (int x = 0; x < FIRE_WIDTH; x++) {
-      int src_idx = (y + 1) * FIRE_WIDTH + x;
-      int val = fire_buffer[src_idx];
-
-      if (val == 0) {
-        fire_buffer[y * FIRE_WIDTH + x] = 0;
-      } else {
-        int decay = rand() % 3;
-        int dst_x = x - (rand() % 3) + 1;
-        if (dst_x < 0)
-          dst_x = 0;
-        if (dst_x >= FIRE_WIDTH)
-          dst_x = FIRE_WIDTH - 1;
-
-        int dst_idx = y * FIRE_WIDTH + dst_x;
-        int new_val = val - decay;
-        if (new_val < 0)
-          new_val = 0;
-
-        fire_buffer[dst_idx] = new_val;
-      }
-    }
-  }
+  doomfire_step(fire);
 
-  // 3. Render to pixels
+  // Render to pixels
   for (int i = 0; i < FIRE_WIDTH * FIRE_HEIGHT; i++) {
     pixel_buffer[i] = palette[fire_buffer[i]];
   }
@@ -261,8 +225,7 @@ void update_fire(void) {
   [self.window makeKeyAndOrderFront:nil];
 
   // Init Fire
-  srand((unsigned)time(NULL));
-  init_palette();
+  init_fire();
 
   // Start Loop
   self.timer = [NSTimer scheduledTimerWithTimeInterval:1.0 / FPS
@@ -0,0 +1,140 @@
+/**
+ * fire-rng.h - Bulk random byte generators for the fire simulations
+ *
+ * The fire kernels need a couple of random bytes per cell per frame. Calling
+ * libc rand() for each of them serializes on a locked LCG, so this header
+ * provides generators that fill whole rows at once:
+ *
+ * - FIRE_RNG_HASH:    counter-based hash (lowbias32). Every output word
+ *                     is a keyed hash of its counter, so the fill loop has
+ *                     no carried state and auto-vectorizes, and any stream
+ *                     (per row, per thread, per frame) can be opened in
+ *                     O(1).
+ * - FIRE_RNG_XOSHIRO: xoshiro256** seeded through splitmix64. Sequential,
+ *                     8 bytes per step, good for one long stream per thread.
+ * - FIRE_RNG_LIBC:    the old rand() path, kept as the benchmark baseline.
+ *                     It ignores the stream and draws from the global state
+ *                     the caller seeds once with srand(), so it is not
+ *                     reproducible when rows are filled on several threads.
+ *
+ * Header-only so the single-file programs can include it directly.
+ */
+
+#ifndef FIRE_RNG_H
+#define FIRE_RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+  FIRE_RNG_HASH = 0,
+  FIRE_RNG_XOSHIRO,
+  FIRE_RNG_LIBC,
+  FIRE_RNG_COUNT
+} FireRngKind;
+
+typedef struct {
+  FireRngKind kind;
+  uint32_t k0, k1; // hash: round keys
+  uint32_t ctr;    // hash: next counter
+  uint64_t s[4];   // xoshiro: state
+} FireRng;
+
+static const char *const fire_rng_names[FIRE_RNG_COUNT] = {"hash", "xoshiro",
+                                                            "libc"};
+
+static inline uint64_t fire_rng_splitmix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// lowbias32 integer hash (C. Wellons); one round of the counter generator
+static inline uint32_t fire_rng_mix32(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7FEB352Du;
+  x ^= x >> 15;
+  x *= 0x846CA68Bu;
+  x ^= x >> 16;
+  return x;
+}
+
+static inline uint64_t fire_rng_rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+// Open stream `stream` of generator family `seed`. Distinct streams are
+// independent, so callers can key them by row, thread or frame.
+static inline void fire_rng_seed(FireRng *r, FireRngKind kind, uint64_t seed,
+                                 uint64_t stream) {
+  uint64_t sm = seed ^ fire_rng_splitmix64(&stream);
+  r->kind = kind;
+  r->ctr = 0;
+  uint64_t k = fire_rng_splitmix64(&sm);
+  r->k0 = (uint32_t)k;
+  r->k1 = (uint32_t)(k >> 32);
+  for (int i = 0; i < 4; i++)
+    r->s[i] = fire_rng_splitmix64(&sm);
+}
+
+static inline uint64_t fire_rng_next64(FireRng *r) {
+  // xoshiro256**
+  uint64_t *s = r->s;
+  uint64_t result = fire_rng_rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = fire_rng_rotl(s[3], 45);
+  return result;
+}
+
+// Fill `out` with `n` random bytes.
+static inline void fire_rng_fill(FireRng *r, uint8_t *out, size_t n) {
+  size_t i = 0;
+  switch (r->kind) {
+  case FIRE_RNG_HASH: {
+    // No loop-carried state: word i only depends on (ctr + i), which lets the
+    // compiler vectorize this loop.
+    const uint32_t k0 = r->k0, k1 = r->k1, ctr = r->ctr;
+    size_t words = n / 4;
+    for (size_t w = 0; w < words; w++) {
+      uint32_t v = fire_rng_mix32(fire_rng_mix32(ctr + (uint32_t)w + k0) ^ k1);
+      memcpy(out + w * 4, &v, 4);
+    }
+    i = words * 4;
+    if (i < n) {
+      uint32_t v =
+          fire_rng_mix32(fire_rng_mix32(ctr + (uint32_t)words + k0) ^ k1);
+      memcpy(out + i, &v, n - i);
+      words++;
+    }
+    r->ctr = ctr + (uint32_t)words;
+    break;
+  }
+  case FIRE_RNG_XOSHIRO:
+    for (; i + 8 <= n; i += 8) {
+      uint64_t v = fire_rng_next64(r);
+      memcpy(out + i, &v, 8);
+    }
+    if (i < n) {
+      uint64_t v = fire_rng_next64(r);
+      memcpy(out + i, &v, n - i);
+    }
+    break;
+  default:
+    for (; i < n; i++)
+      out[i] = (uint8_t)(rand() >> 7);
+    break;
+  }
+}
+
+// Map a random byte to [0, n) without a division: floor(r * n / 256).
+static inline int fire_rng_range(uint8_t r, int n) { return (r * n) >> 8; }
+
+#endif // FIRE_RNG_H
@@ -5,19 +5,62 @@
  * modern terminals with TrueColor support.
  *
  * Compile with:
- *   clang -O3 -march=native -mtune=native fire.c -o fire
+ *   clang -O3 -pthread fire.c doomfire.c -o fire
+ *
+ * No -march flag is needed: the SIMD kernels are compiled per target and
+ * picked at startup from what the CPU reports (see --kernel).
  *
  * Features:
  * - Raw terminal mode (no curses)
  * - Double-buffered heat map
- * - Optimized rendering (delta updates, buffered I/O)
+ * - Optimized rendering (delta updates, cell escapes preformatted per
+ *   palette, one SGR per run of same-color cells, whole frames sent with
+ *   one writev from a writer thread that drops frames the terminal cannot
+ *   keep up with, bracketed as synchronized updates where supported)
+ * - Frames encoded in bands of rows in parallel on the simulation's worker
+ *   pool, byte for byte the same as on one thread
  * - TrueColor (24-bit) with fallback to 256-color
+ * - Half-block glyphs (--glyph half): ▀ in two colors shows two heat cells
+ *   per character, with foreground and background SGR tracked separately;
+ *   quadrant, sextant and braille glyphs show 4, 6 and 8 in two colors
+ * - Sixel backend (--backend sixel): one bitmap per frame at pixel
+ *   resolution, heat values as color registers, run-length encoded bands
+ * - Kitty graphics backend (--backend kitty): RGBA frames in POSIX shared
+ *   memory so each costs the tty a few dozen bytes, a new object per frame
+ *   sent and at most 16 the terminal has not taken; inline base64 RGB where
+ *   shared memory is unavailable
  * - Adaptive resizing
- * - 60+ FPS target
+ * - 60+ FPS target (--fps), frames on absolute deadlines: epoll with a
+ *   timerfd and signalfd on Linux, poll() elsewhere; missed frames skipped
+ *   or caught up (--late), period jitter in --stats
+ * - Simulation in the shared doomfire core (doomfire.h):
+ *   - Bulk counter-based RNG (fire-rng.h), see --bench for throughput
+ *   - SSE2/AVX2/AVX-512/NEON propagation kernels with runtime dispatch
+ *   - Band-parallel propagation on a persistent worker pool (--threads)
+ *   - Gather-based pull propagation with ping-pong buffers (--propagate pull)
+ *   - Cold rows above the flames are skipped by the simulation and renderer
+ *   - Temporal blocking (wavefront order) for grids larger than the cache
+ *   - Batches of same-size fires interleaved so SIMD lanes span instances
+ *   - 16-bit fixed-point heat with fractional cooling for tall fires
+ *     without banding (--heat 16 --cooling 0.5)
+ * - Render modes timed on a pseudo-terminal (--bench-pty): frames/s,
+ *   bytes and writes per frame and frame time tails, with no terminal
+ * - Deterministic runs with --seed, golden frame hashes in fire-golden.txt
+ *   (check with: fire --golden fire-golden.txt)
+ * - VT screen model fed the frames as sent: --golden checks the screen
+ *   against the heat in every glyph mode, --bench counts the cells each
+ *   encoding makes the terminal print and erase
  */
 
 #define _DARWIN_C_SOURCE
 #define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600 // posix_openpt
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -25,53 +68,128 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#endif
+
+#include "doomfire.h"
+
 // --- Configuration ---
 #define TARGET_FPS 60
-#define FRAME_DELAY_NS (1000000000L / TARGET_FPS)
-#define COOLING_MIN 0
 #define COOLING_MAX 3   // Slightly more aggressive cooling for taller flames
 #define SPARK_CHANCE 60 // % chance of a spark in a bottom cell
 
 // --- Globals ---
 static struct termios orig_termios;
-static int width = 0;
+static int term_cols = 0; // terminal the buffers are sized for
+static int term_rows = 0;
+static int width = 0; // heat grid, one cell per glyph pixel
 static int height = 0;
-static uint8_t *fire_buffer = NULL; // Current heat state
-static uint8_t *prev_buffer = NULL; // Previous frame for delta rendering
+static uint8_t *fire_buffer = NULL; // Heat buffers handed to the simulation
+static uint8_t *prev_buffer = NULL; // Back buffer for pull propagation
+static uint8_t *frame_cells = NULL; // palette indices of 16-bit heat
+static uint32_t *screen = NULL;     // frame reduced to terminal cells
+static uint8_t *screen_hot = NULL;  // per terminal row: any heat
+static uint32_t *shown = NULL;      // terminal cells on screen, for delta
+static uint8_t *shown_cold = NULL;  // per terminal row: every cell is black
+static uint32_t *base = NULL;       // shown before the frame in the mailbox
+static uint8_t *base_cold = NULL;
+static bool shown_valid = false;    // false forces a full repaint
+static bool screen_clear = false;   // the next frame starts with a clear
+static bool shown_truecolor;        // color mode of the shown keys
+// Output backend: text cells, or a bitmap on terminals with graphics
+typedef enum {
+  BACKEND_TEXT = 0,
+  BACKEND_SIXEL,
+  BACKEND_KITTY,
+  BACKEND_COUNT
+} Backend;
+static const char *const backend_names[BACKEND_COUNT] = {"text", "sixel",
+                                                         "kitty"};
+static Backend backend = BACKEND_TEXT;
+static int cell_px_w = 0, cell_px_h = 0; // pixels per terminal cell
+static int pixel_scale = 2;              // pixels per heat cell in bitmaps
+static double cooling = COOLING_MAX; // heat levels lost per row, at most
 static bool running = true;
+static bool resize_pending = false; // SIGWINCH came
+static int target_fps = TARGET_FPS;
 static bool truecolor = true;
 
+// The simulation and the options it is (re)created with on resize
+static DoomFire *fire = NULL;
+static DoomFireConfig fire_cfg;
+
+// Counters of simulations already destroyed, printed on exit with --stats
+static DoomFireStats stats;
+
 // Precomputed Palette (RGB for TrueColor, Index for 256-color)
+static DoomFireRGB palette_rgb[256];
+static uint8_t palette_256[256];
+
+// The escape that paints one cell, "\033[48;2;R;G;Bm " or "\033[48;5;Nm ",
+// formatted once per palette for every intensity in both color modes. Slots
+// have a fixed size so render() copies whole slots without branching on the
+// length and only advances by the real one.
 typedef struct {
-  uint8_t r, g, b;
-} ColorRGB;
+  char bytes[31];
+  uint8_t len; // including the trailing space
+} EscSlot;
 
-static ColorRGB palette_rgb[256];
-static uint8_t palette_256[256];
+static EscSlot esc_cache[2][256]; // [truecolor][intensity]
+// Lowest intensity with the same escape, so equal colors compare equal
+static uint8_t esc_color[2][256];
+// Foreground escapes of the same colors, "\033[38;2;R;G;Bm" or
+// "\033[38;5;Nm", for glyphs that paint part of a cell
+static EscSlot fg_cache[2][256];
+// Sixel color register definitions, "#N;2;R;G;B" in percent
+static EscSlot sixel_regs[256];
+// Kitty image pixels, R, G, B, A
+static uint8_t kitty_rgba[256][4];
+
+static double now_sec(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
 
 // --- Terminal Handling ---
 
+// Synchronized output (DEC private mode 2026): the terminal holds back
+// repainting between "\033[?2026h" and "\033[?2026l", so a frame shows all
+// at once and is drawn in one pass
+typedef enum { SYNC_AUTO = 0, SYNC_ON, SYNC_OFF, SYNC_COUNT } SyncMode;
+static const char *const sync_names[SYNC_COUNT] = {"auto", "on", "off"};
+static bool sync_output = false;
+
+#define PROBE_TIMEOUT_MS 200
+
 void restore_terminal(void) {
-  // Restore cursor, disable alt screen, reset color, show cursor
-  printf("\033[?25h\033[?1049l\033[0m");
+  // End a synchronized update, delete the kitty image, restore cursor,
+  // disable alt screen, reset color, show cursor
+  printf("%s%s\033[?25h\033[?1049l\033[0m", sync_output ? "\033[?2026l" : "",
+         backend == BACKEND_KITTY ? "\033_Ga=d,d=A,q=2\033\\" : "");
   fflush(stdout);
   tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
 }
 
+// From a handler, or from the frame loop's signalfd. The new size is read
+// at the start of the next frame, outside the handler.
 void handle_signal(int sig) {
-  if (sig == SIGINT) {
+  if (sig == SIGINT || sig == SIGTERM)
     running = false;
-  } else if (sig == SIGWINCH) {
-    // Just flag or let the main loop handle it.
-    // For simplicity in this raw loop, we'll check ioctl every frame or so,
-    // but a signal handler is safer for blocking calls.
-    // We will re-query size in the main loop to be safe and avoid race
-    // conditions with malloc.
-  }
+  else if (sig == SIGWINCH)
+    resize_pending = true;
 }
 
 void init_terminal(void) {
@@ -109,35 +227,60 @@ void init_terminal(void) {
   }
 
   signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
   signal(SIGWINCH, handle_signal);
 }
 
+// Whether buf holds a DA1 reply, "\033[?...c"
+static bool has_da1(const char *buf) {
+  for (const char *r = strstr(buf, "\033[?"); r; r = strstr(r + 1, "\033[?")) {
+    r += 3;
+    while ((*r >= '0' && *r <= '9') || *r == ';')
+      r++;
+    if (*r == 'c')
+      return true;
+  }
+  return false;
+}
+
+// Send `query`, then ask for the device attributes (DA1), which every
+// terminal answers: replies to the query come first, so once the DA1 reply
+// is in, the terminal has said all it will. Collects what it sends in buf,
+// NUL-terminated. Needs the terminal in raw mode.
+static void probe_terminal(const char *query, char *buf, int size) {
+  int len = 0;
+  buf[0] = 0;
+  if (write(STDOUT_FILENO, query, strlen(query)) < 0 ||
+      write(STDOUT_FILENO, "\033[c", 3) < 0)
+    return;
+  double deadline = now_sec() + PROBE_TIMEOUT_MS / 1000.0;
+  while (len < size - 1 && !has_da1(buf)) {
+    int wait = (int)((deadline - now_sec()) * 1000);
+    struct pollfd p = {.fd = STDIN_FILENO, .events = POLLIN};
+    if (wait <= 0 || poll(&p, 1, wait) <= 0)
+      break;
+    ssize_t n = read(STDIN_FILENO, buf + len, size - 1 - len);
+    if (n <= 0)
+      break;
+    len += n;
+    buf[len] = 0;
+  }
+}
+
+// Ask whether the terminal knows mode 2026 (DECRQM): it replies
+// "\033[?2026;N$y", N 1 (set) or 2 (reset) when it does
+static bool probe_sync_output(void) {
+  char buf[256];
+  probe_terminal("\033[?2026$p", buf, sizeof(buf));
+  const char *r = strstr(buf, "\033[?2026;");
+  return r && (r[8] == '1' || r[8] == '2') && r[9] == '$';
+}
+
 // --- Palette Generation ---
 
 void init_palette(void) {
-  // Generate a fire palette: Black -> Red -> Orange -> Yellow -> White
+  doomfire_palette_rgb(palette_rgb);
   for (int i = 0; i < 256; i++) {
-    ColorRGB c = {0, 0, 0};
-    if (i < 64) {
-      // Black to Red
-      c.r = i * 4;
-    } else if (i < 128) {
-      // Red to Yellow
-      c.r = 255;
-      c.g = (i - 64) * 4;
-    } else if (i < 192) {
-      // Yellow to White
-      c.r = 255;
-      c.g = 255;
-      c.b = (i - 128) * 4;
-    } else {
-      // White
-      c.r = 255;
-      c.g = 255;
-      c.b = 255;
-    }
-    palette_rgb[i] = c;
-
     // Approximate 256-color mapping (standard xterm 256 cube/grayscale)
     // This is a rough approximation.
     if (i == 0)
@@ -151,79 +294,479 @@ void init_palette(void) {
     else
       palette_256[i] = 231; // White
   }
+
+  for (int i = 0; i < 256; i++) {
+    DoomFireRGB c = palette_rgb[i];
+    EscSlot *e = &esc_cache[1][i];
+    e->len = snprintf(e->bytes, sizeof(e->bytes), "\033[48;2;%d;%d;%dm ", c.r,
+                      c.g, c.b);
+    e = &esc_cache[0][i];
+    e->len = snprintf(e->bytes, sizeof(e->bytes), "\033[48;5;%dm ",
+                      palette_256[i]);
+    e = &fg_cache[1][i];
+    e->len = snprintf(e->bytes, sizeof(e->bytes), "\033[38;2;%d;%d;%dm", c.r,
+                      c.g, c.b);
+    e = &fg_cache[0][i];
+    e->len = snprintf(e->bytes, sizeof(e->bytes), "\033[38;5;%dm",
+                      palette_256[i]);
+    memcpy(kitty_rgba[i], (uint8_t[4]){c.r, c.g, c.b, 255}, 4);
+    e = &sixel_regs[i];
+    e->len = snprintf(e->bytes, sizeof(e->bytes), "#%d;2;%d;%d;%d", i,
+                      (c.r * 100 + 127) / 255, (c.g * 100 + 127) / 255,
+                      (c.b * 100 + 127) / 255);
+  }
+  for (int tc = 0; tc < 2; tc++)
+    for (int i = 0; i < 256; i++) {
+      const EscSlot *e = esc_cache[tc];
+      int j = 0;
+      while (e[j].len != e[i].len || memcmp(e[j].bytes, e[i].bytes, e[i].len))
+        j++;
+      esc_color[tc][i] = j;
+    }
+}
+
+// --- Glyph Modes ---
+//
+// A terminal cell can show more than one heat cell. With the half block ▀
+// its foreground paints the upper heat cell and its background the lower
+// one, which doubles the vertical resolution; quadrant, sextant and braille
+// glyphs split the cell 2x2, 2x3 and 2x4. Frames are reduced to one packed
+// cell per terminal cell: a glyph mask (bit i set where heat cell i,
+// counted row by row, takes the foreground) plus the foreground and
+// background esc_color keys. Cells of more than two colors are split in
+// two around the middle of their heat range.
+
+typedef enum {
+  GLYPH_FULL = 0,
+  GLYPH_HALF,
+  GLYPH_QUADRANT,
+  GLYPH_SEXTANT,
+  GLYPH_BRAILLE,
+  GLYPH_COUNT
+} GlyphMode;
+
+static const char *const glyph_names[GLYPH_COUNT] = {
+    "full", "half", "quadrant", "sextant", "braille"};
+
+typedef struct {
+  int cw, ch; // heat cells per terminal cell, across and down
+  int solid;  // mask of the glyph filling the cell, -1 if none
+} GlyphInfo;
+
+static const GlyphInfo glyph_modes[GLYPH_COUNT] = {
+    {1, 1, 1}, {1, 2, 3}, {2, 2, 15}, {2, 3, 63}, {2, 4, -1},
+};
+
+static GlyphMode glyph_mode = GLYPH_FULL;
+static const GlyphInfo *glyph = &glyph_modes[GLYPH_FULL];
+
+// Block elements by mask; bits are upper left, upper right, lower left and
+// lower right.
+static const uint16_t quadrant_glyphs[16] = {
+    ' ',    0x2598, 0x259D, 0x2580, 0x2596, 0x258C, 0x259E, 0x259B,
+    0x2597, 0x259A, 0x2590, 0x259C, 0x2584, 0x2599, 0x259F, 0x2588,
+};
+
+// Code point of the glyph that shows `mask` in mode m
+static uint32_t glyph_codepoint(GlyphMode m, int mask) {
+  switch (m) {
+  case GLYPH_FULL:
+    return mask ? 0x2588 : ' ';
+  case GLYPH_HALF:
+    return quadrant_glyphs[(mask & 1) * 3 + (mask >> 1) * 12];
+  case GLYPH_QUADRANT:
+    return quadrant_glyphs[mask];
+  case GLYPH_SEXTANT:
+    // U+1FB00 onwards in mask order, leaving out the three that are block
+    // elements already: both halves and the full block
+    if (mask == 21 || mask == 42 || mask == 63)
+      return quadrant_glyphs[mask == 21 ? 5 : mask == 42 ? 10 : 15];
+    return mask ? 0x1FB00 + mask - 1 - (mask > 21) - (mask > 42) : ' ';
+  default: {
+    // Braille numbers its dots down the left column, then the right, with
+    // the bottom row last
+    static const uint8_t dot[8] = {0x01, 0x08, 0x02, 0x10,
+                                   0x04, 0x20, 0x40, 0x80};
+    int bits = 0;
+    for (int i = 0; i < 8; i++)
+      bits |= (mask >> i & 1) * dot[i];
+    return mask ? 0x2800 + bits : ' ';
+  }
+  }
+}
+
+// The glyph of every mask of the current mode as UTF-8, in fixed-size slots
+// like EscSlot
+typedef struct {
+  char bytes[7];
+  uint8_t len;
+} GlyphSlot;
+
+static GlyphSlot glyph_slots[256];
+
+static int utf8_encode(uint32_t cp, char *out) {
+  if (cp < 0x80) {
+    out[0] = (char)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = (char)(0xC0 | cp >> 6);
+    out[1] = (char)(0x80 | (cp & 0x3F));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = (char)(0xE0 | cp >> 12);
+    out[1] = (char)(0x80 | (cp >> 6 & 0x3F));
+    out[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+  }
+  out[0] = (char)(0xF0 | cp >> 18);
+  out[1] = (char)(0x80 | (cp >> 12 & 0x3F));
+  out[2] = (char)(0x80 | (cp >> 6 & 0x3F));
+  out[3] = (char)(0x80 | (cp & 0x3F));
+  return 4;
+}
+
+// Switch modes; the next resize_buffers() sizes the heat grid for it
+static void set_glyph_mode(GlyphMode m) {
+  glyph_mode = m;
+  glyph = &glyph_modes[m];
+  for (int mask = 0; mask < 1 << glyph->cw * glyph->ch; mask++) {
+    GlyphSlot *g = &glyph_slots[mask];
+    g->len = (uint8_t)utf8_encode(glyph_codepoint(m, mask), g->bytes);
+  }
+  term_cols = term_rows = 0;
 }
 
+static inline uint32_t cell_pack(int mask, int fg, int bg) {
+  return (uint32_t)mask | (uint32_t)fg << 8 | (uint32_t)bg << 16;
+}
+
+static inline int cell_mask(uint32_t c) { return c & 0xFF; }
+static inline int cell_fg(uint32_t c) { return c >> 8 & 0xFF; }
+static inline int cell_bg(uint32_t c) { return c >> 16 & 0xFF; }
+
 // --- Simulation ---
 
-void resize_buffers(int w, int h) {
-  if (w == width && h == height)
+static void destroy_fire(void) {
+  if (!fire)
+    return;
+  const DoomFireStats *s = doomfire_stats(fire);
+  stats.frames += s->frames;
+  stats.cells += s->cells;
+  stats.cells_skipped += s->cells_skipped;
+  doomfire_destroy(fire);
+  fire = NULL;
+}
+
+// Switch fire_cfg between 8- and 16-bit heat at the --cooling rate. 8-bit
+// cooling has whole levels only.
+static void set_heat16(bool heat16) {
+  fire_cfg.heat16 = heat16;
+  fire_cfg.cooling_max = (int)(cooling * (heat16 ? 256 : 1) + 0.5);
+}
+
+// Palette index of cell i of a heat buffer in the format of fire_cfg
+static inline uint8_t heat_index(const uint8_t *heat, size_t i) {
+  return fire_cfg.heat16 ? doomfire_heat16_index(((const uint16_t *)heat)[i])
+                         : heat[i];
+}
+
+// (Re)create the simulation on the current buffers from fire_cfg
+static void create_fire(void) {
+  destroy_fire();
+  fire_cfg.width = width;
+  fire_cfg.height = height;
+  fire_cfg.stride = (ptrdiff_t)width * (fire_cfg.heat16 ? 2 : 1);
+  fire_cfg.heat = fire_buffer;
+  fire_cfg.back = prev_buffer;
+  fire = doomfire_create(&fire_cfg);
+  if (!fire) {
+    fprintf(stderr, "cannot create a %dx%d fire\n", width, height);
+    exit(1);
+  }
+}
+
+// Size everything for a cols x rows terminal in the current glyph mode. The
+// last terminal row stays empty and the bottom heat row, the fire source,
+// off screen.
+void resize_buffers(int cols, int rows) {
+  if (cols == term_cols && rows == term_rows)
     return;
 
+  destroy_fire();
   free(fire_buffer);
   free(prev_buffer);
+  free(frame_cells);
+  free(screen);
+  free(screen_hot);
+  free(shown);
+  free(shown_cold);
+  free(base);
+  free(base_cold);
+
+  term_cols = cols;
+  term_rows = rows;
+  if (backend == BACKEND_TEXT) {
+    width = cols * glyph->cw;
+    height = rows > 1 ? (rows - 1) * glyph->ch + 1 : rows;
+  } else {
+    // A bitmap over the terminal above its last row, in heat cells of
+    // pixel_scale pixels (and whole sixel bands), plus the source row
+    int band = backend == BACKEND_SIXEL ? 6 / pixel_scale : 1;
+    width = cols * cell_px_w / pixel_scale;
+    height = rows > 1 ? (rows - 1) * cell_px_h / pixel_scale / band * band + 1
+                      : rows;
+  }
+
+  // Allocate buffers, with room for 16-bit heat either way so the benchmark
+  // can switch formats on the same grid
+  fire_buffer = calloc(width * height, sizeof(uint16_t));
+  prev_buffer = calloc(width * height, sizeof(uint16_t));
+  frame_cells = calloc(width * height, 1);
+  screen = calloc((size_t)cols * rows, sizeof(uint32_t));
+  screen_hot = calloc(rows, 1);
+  shown = calloc((size_t)cols * rows, sizeof(uint32_t));
+  shown_cold = calloc(rows, 1);
+  base = calloc((size_t)cols * rows, sizeof(uint32_t));
+  base_cold = calloc(rows, 1);
+  shown_valid = false; // the screen is cleared or reflowed
+  create_fire();
+}
+
+// --- Screen Model ---
+//
+// A VT parser and screen, fed the bytes of each frame as sent, to check what
+// they leave on a terminal and count the work they cost it. It reads what
+// the renderer sends: UTF-8 text, LF, CR, CUP, cursor moves, ED, EL and SGR
+// colors, with background color erase and the pending wrap after the last
+// column as in xterm. DEC private modes are ignored and DCS, APC and OSC
+// strings (sixel, kitty) skipped; anything else counts as unknown.
+
+#define VT_RGB 0x1000000 // flags a 0xRRGGBB color, else a 256-color index
+
+typedef struct {
+  uint32_t cp;    // code point
+  int32_t fg, bg; // VT_RGB | RGB, a 256-color index or -1 for the default
+} VtCell;
+
+typedef enum { VT_GROUND, VT_ESC, VT_CSI, VT_STRING, VT_STRING_ESC } VtState;
+
+typedef struct {
+  int cols, rows;
+  VtCell *cells;
+  int cy, cx;
+  bool wrap; // the last column is printed, the next glyph goes below
+  int32_t fg, bg;
+  VtState state;
+  int params[16], nparams;
+  bool private_mode; // "\033[?"
+  uint32_t cp;       // UTF-8 sequence being decoded
+  int cont;          // its continuation bytes still to come
+  // Work since vt_resize(): bytes read, cells printed and erased, cells left
+  // with another glyph or colors, escapes and unknown sequences among them
+  uint64_t bytes, painted, erased, changed, escapes, unknown;
+} VtScreen;
+
+static VtScreen *out_model = NULL; // fed every frame sent, if set
+
+// A blank screen of cols x rows in default colors, counters at zero
+static void vt_resize(VtScreen *s, int cols, int rows) {
+  VtCell *cells = realloc(s->cells, (size_t)cols * rows * sizeof(VtCell));
+  *s = (VtScreen){.cells = cells, .cols = cols, .rows = rows};
+  s->fg = s->bg = -1;
+  for (int i = 0; i < cols * rows; i++)
+    cells[i] = (VtCell){' ', -1, -1};
+}
+
+static void vt_put(VtScreen *s, int y, int x, uint32_t cp) {
+  VtCell *c = &s->cells[(size_t)y * s->cols + x];
+  VtCell n = {cp, cp == ' ' ? -1 : s->fg, s->bg}; // a space has no fg
+  s->changed += c->cp != n.cp || c->fg != n.fg || c->bg != n.bg;
+  *c = n;
+}
 
-  width = w;
-  height = h;
+// Erase row y, columns [x0, x1), in the current background
+static void vt_erase(VtScreen *s, int y, int x0, int x1) {
+  for (int x = x0; x < x1; x++)
+    vt_put(s, y, x, ' ');
+  s->erased += x1 - x0;
+}
 
-  // Allocate buffers. We add some padding to avoid boundary checks if we
-  // wanted, but precise sizing is fine with careful loops.
-  fire_buffer = calloc(width * height, 1);
-  prev_buffer = calloc(width * height, 1);
+static void vt_linefeed(VtScreen *s) {
+  if (s->cy + 1 < s->rows) {
+    s->cy++;
+    return;
+  }
+  memmove(s->cells, s->cells + s->cols,
+          (size_t)s->cols * (s->rows - 1) * sizeof(VtCell));
+  for (int x = 0; x < s->cols; x++)
+    s->cells[(size_t)(s->rows - 1) * s->cols + x] = (VtCell){' ', -1, -1};
+  vt_erase(s, s->rows - 1, 0, s->cols);
+}
 
-  // Clear screen on resize
-  printf("\033[2J");
+static void vt_print(VtScreen *s, uint32_t cp) {
+  if (s->wrap) {
+    s->cx = 0;
+    vt_linefeed(s);
+    s->wrap = false;
+  }
+  vt_put(s, s->cy, s->cx, cp);
+  s->painted++;
+  if (s->cx + 1 < s->cols)
+    s->cx++;
+  else
+    s->wrap = true;
 }
 
-// The core fire algorithm
-void update_fire(void) {
-  // 1. Seed the bottom row
-  int last_row_idx = (height - 1) * width;
-  for (int x = 0; x < width; x++) {
-    // Randomly ignite
-    if ((rand() % 100) < SPARK_CHANCE) {
-      // High intensity with some variation
-      fire_buffer[last_row_idx + x] = 255 - (rand() % 50);
+static void vt_sgr(VtScreen *s) {
+  const int *p = s->params;
+  int n = s->nparams;
+  if (!n)
+    s->fg = s->bg = -1;
+  for (int i = 0; i < n; i++) {
+    bool ext = p[i] == 38 || p[i] == 48; // extended color, fg or bg
+    int32_t *c = p[i] == 38 || p[i] == 39 ? &s->fg : &s->bg;
+    if (p[i] == 0) {
+      s->fg = s->bg = -1;
+    } else if (p[i] == 39 || p[i] == 49) {
+      *c = -1;
+    } else if (ext && i + 2 < n && p[i + 1] == 5) {
+      *c = p[i + 2] & 255;
+      i += 2;
+    } else if (ext && i + 4 < n && p[i + 1] == 2) {
+      *c = VT_RGB | (p[i + 2] & 255) << 16 | (p[i + 3] & 255) << 8 |
+           (p[i + 4] & 255);
+      i += 4;
+    } else if (p[i] >= 30 && p[i] <= 37) {
+      s->fg = p[i] - 30;
+    } else if (p[i] >= 40 && p[i] <= 47) {
+      s->bg = p[i] - 40;
     } else {
-      // Decay the source slightly so it's not a solid bar
-      if (fire_buffer[last_row_idx + x] > 10)
-        fire_buffer[last_row_idx + x] -= 5;
+      s->unknown++;
     }
   }
+}
 
-  // 2. Propagate up
-  // We iterate from row 0 to height-2.
-  // For each pixel, we look at the pixels BELOW it.
-  // Actually, standard Doom fire works by iterating the source pixels and
-  // spreading to target. Let's do: Target[x, y] = (Source[x, y+1] + Source[x-1,
-  // y+1] + Source[x+1, y+1]) / 3 - decay
+static int vt_clamp(int v, int n) { return v < 0 ? 0 : v >= n ? n - 1 : v; }
 
-  for (int y = 0; y < height - 1; y++) {
-    for (int x = 0; x < width; x++) {
-      int src_idx = (y + 1) * width + x;
-
-      // Simple average of the pixel below and its neighbors
-      // We need to be careful with bounds for x-1 and x+1
-      // To optimize, we can handle edges separately or just clamp.
-      // For raw speed, let's just do a simple spread from below.
-
-      int decay = rand() % (COOLING_MAX + 1);
-
-      // Read from the pixel below
-      int val = fire_buffer[src_idx];
-
-      // Add some randomness from neighbors to simulate wind/diffusion
-      if (val > 0) {
-        int rand_idx = rand() % 3;    // 0, 1, 2
-        int dst_x = x - rand_idx + 1; // x-1, x, x+1
-        if (dst_x >= 0 && dst_x < width) {
-          int dst_idx = y * width + dst_x;
-          int new_val = val - decay;
-          if (new_val < 0)
-            new_val = 0;
-          fire_buffer[dst_idx] = new_val;
-        }
+static void vt_csi(VtScreen *s, char final) {
+  int a = s->nparams > 0 ? s->params[0] : 0;
+  int b = s->nparams > 1 ? s->params[1] : 0;
+  int n = a ? a : 1; // counts default to 1
+  s->escapes++;
+  if (s->private_mode) {
+    s->unknown += final != 'h' && final != 'l';
+    return;
+  }
+  if (final != 'm')
+    s->wrap = false;
+  switch (final) {
+  case 'H':
+    s->cy = vt_clamp(n - 1, s->rows);
+    s->cx = vt_clamp((b ? b : 1) - 1, s->cols);
+    break;
+  case 'A':
+  case 'B':
+    s->cy = vt_clamp(s->cy + (final == 'B' ? n : -n), s->rows);
+    break;
+  case 'C':
+  case 'D':
+    s->cx = vt_clamp(s->cx + (final == 'C' ? n : -n), s->cols);
+    break;
+  case 'J':
+    for (int y = 0; y < s->rows; y++)
+      if (a == 2 || (a == 0 && y > s->cy) || (a == 1 && y < s->cy))
+        vt_erase(s, y, 0, s->cols);
+    if (a == 0)
+      vt_erase(s, s->cy, s->cx, s->cols);
+    else if (a == 1)
+      vt_erase(s, s->cy, 0, s->cx + 1);
+    break;
+  case 'K':
+    vt_erase(s, s->cy, a == 0 ? s->cx : 0, a == 1 ? s->cx + 1 : s->cols);
+    break;
+  case 'm':
+    vt_sgr(s);
+    break;
+  default:
+    s->unknown++;
+  }
+}
+
+static void vt_feed(VtScreen *s, const char *buf, size_t len) {
+  s->bytes += len;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = (uint8_t)buf[i];
+    switch (s->state) {
+    case VT_ESC:
+      s->state = VT_GROUND;
+      if (c == '[') {
+        s->state = VT_CSI;
+        s->nparams = 0;
+        s->private_mode = false;
+      } else if (c == 'P' || c == '_' || c == ']' || c == '^' || c == 'X') {
+        s->state = VT_STRING;
       } else {
-        fire_buffer[y * width + x] = 0;
+        s->escapes++;
+        s->unknown++;
+      }
+      break;
+    case VT_CSI:
+      if (c >= '0' && c <= '9') {
+        if (!s->nparams)
+          s->params[s->nparams++] = 0;
+        int *p = &s->params[s->nparams - 1];
+        if (*p < 100000)
+          *p = *p * 10 + (c - '0');
+      } else if (c == ';') {
+        if (!s->nparams)
+          s->params[s->nparams++] = 0;
+        if (s->nparams < 16)
+          s->params[s->nparams++] = 0;
+      } else if (c == '?') {
+        s->private_mode = true;
+      } else if (c >= 0x40 && c <= 0x7E) {
+        vt_csi(s, (char)c);
+        s->state = VT_GROUND;
+      }
+      break;
+    case VT_STRING:
+      if (c == '\033') {
+        s->state = VT_STRING_ESC;
+      } else if (c == '\a') { // OSC may end in BEL
+        s->state = VT_GROUND;
+        s->escapes++;
+      }
+      break;
+    case VT_STRING_ESC:
+      s->state = c == '\\' ? VT_GROUND : VT_STRING;
+      s->escapes += c == '\\';
+      break;
+    default:
+      if (s->cont && (c & 0xC0) == 0x80) {
+        s->cp = s->cp << 6 | (c & 0x3F);
+        if (!--s->cont)
+          vt_print(s, s->cp);
+        break;
+      }
+      s->unknown += s->cont != 0; // a sequence cut short
+      s->cont = 0;
+      if (c == '\033') {
+        s->state = VT_ESC;
+      } else if (c == '\n') {
+        vt_linefeed(s);
+        s->wrap = false;
+      } else if (c == '\r') {
+        s->cx = 0;
+        s->wrap = false;
+      } else if (c >= 0x20 && c < 0x7F) {
+        vt_print(s, c);
+      } else if (c >= 0xC0 && c < 0xF8) {
+        s->cont = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1;
+        s->cp = c & 0x3F >> s->cont;
+      } else if (c >= 0x80) {
+        s->unknown++;
       }
     }
   }
@@ -231,107 +774,2877 @@ void update_fire(void) {
 
 // --- Rendering ---
 
-// Large output buffer to minimize syscalls
-#define OUT_BUF_SIZE (256 * 1024)
-static char out_buf[OUT_BUF_SIZE];
-static int out_buf_len = 0;
+// A frame is encoded into lists of fixed-size chunks and sent whole with
+// writev(): the terminal never sees half a frame, and encoded bytes are not
+// copied again. A full chunk is closed with next_chunk() and encoding goes
+// on in the next one. Chunks stay allocated for the following frames.
+//
+// The frame is split into parts, each encoded by one thread into its own
+// chunks: a head, one part per band of terminal rows, and a tail. Parts are
+// sent in order, so bands can be encoded in parallel.
+#define OUT_BUF_SIZE (64 * 1024)
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+typedef struct {
+  char **chunks;     // OUT_BUF_SIZE bytes each, allocated on first use
+  struct iovec *iov; // one per chunk
+  int count;         // chunks holding the part
+  int cap;
+} FramePart;
+
+typedef struct {
+  FramePart *parts; // in output order
+  int count;        // parts in the frame
+  int cap;
+  struct iovec *iov; // chunks of all parts, once the frame is finished
+  int iov_count;
+  int iov_cap;
+  size_t bytes; // in all chunks, once the frame is finished
+  bool repaint; // a full repaint, not a delta
+  bool clears;  // starts by clearing the screen
+  bool sent;    // its last frame went out, rather than being dropped
+} FrameBuf;
+
+// Two frames: one being encoded while the writer thread sends the other
+static FrameBuf frame_bufs[2];
+static FrameBuf *out_frame = &frame_bufs[0]; // being encoded
+// Per encoding thread: its part of out_frame and that part's last chunk
+static _Thread_local FramePart *out_part = NULL;
+static _Thread_local char *out_buf = NULL;
+static _Thread_local int out_buf_len = OUT_BUF_SIZE; // full until a chunk
+static int out_fd = STDOUT_FILENO; // the benchmark renders into /dev/null
+static bool sgr_runs = true; // off only to measure the savings in --bench
+static int color_shift = 0;  // low heat bits dropped, to cut output
+
+// Bytes written, write calls and frames rendered, for --stats and --bench
+static uint64_t out_bytes = 0;
+static uint64_t out_writes = 0;
+static uint64_t out_frames = 0;
+
+static void next_chunk(void) {
+  FramePart *p = out_part;
+  if (p->count)
+    p->iov[p->count - 1].iov_len = out_buf_len;
+  if (p->count == p->cap) {
+    p->cap = p->cap ? 2 * p->cap : 4;
+    p->chunks = realloc(p->chunks, p->cap * sizeof(*p->chunks));
+    p->iov = realloc(p->iov, p->cap * sizeof(*p->iov));
+    for (int i = p->count; i < p->cap; i++)
+      p->chunks[i] = NULL;
+  }
+  if (!p->chunks[p->count])
+    p->chunks[p->count] = malloc(OUT_BUF_SIZE);
+  out_buf = p->chunks[p->count++];
+  out_buf_len = 0;
+}
+
+// Encode into part i of out_frame on this thread
+static void part_begin(int i) {
+  out_part = &out_frame->parts[i];
+  out_part->count = 0;
+  out_buf_len = OUT_BUF_SIZE;
+}
+
+static void part_end(void) {
+  if (out_part->count)
+    out_part->iov[out_part->count - 1].iov_len = out_buf_len;
+}
+
+// Write all of iov[0, n), at most IOV_MAX entries per call, resuming after
+// partial writes, interrupts and a full nonblocking fd. False on errors.
+static bool write_all(int fd, struct iovec *iov, int n) {
+  while (n > 0) {
+    ssize_t w = writev(fd, iov, n < IOV_MAX ? n : IOV_MAX);
+    if (w < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd p = {.fd = fd, .events = POLLOUT};
+        poll(&p, 1, -1);
+      } else if (errno != EINTR) {
+        return false;
+      }
+      continue;
+    }
+    out_writes++;
+    for (; n > 0 && (size_t)w >= iov->iov_len; iov++, n--)
+      w -= iov->iov_len;
+    if (n > 0) {
+      iov->iov_base = (char *)iov->iov_base + w;
+      iov->iov_len -= w;
+    }
+  }
+  return true;
+}
+
+static bool write_frame(FrameBuf *f) {
+  out_bytes += f->bytes;
+  if (out_model) // before write_all() moves the iovs along
+    for (int i = 0; i < f->iov_count; i++)
+      vt_feed(out_model, f->iov[i].iov_base, f->iov[i].iov_len);
+  return write_all(out_fd, f->iov, f->iov_count);
+}
+
+// --- Writer Thread ---
+//
+// On a slow terminal or link write() blocks, and the main loop with it. With
+// the writer thread it hands finished frames over in a one-slot mailbox
+// instead. A frame still waiting there when the next one is done is not
+// queued behind it: frame_begin() takes it back, and the new frame replaces
+// it, encoded against the screen the dropped one would have updated. The
+// screen then catches up to the newest frame as soon as the terminal can.
+
+static bool async_write = false;
+static pthread_t writer;
+static pthread_mutex_t mb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mb_cond = PTHREAD_COND_INITIALIZER;
+static FrameBuf *mb_pending = NULL; // in the mailbox
+static FrameBuf *mb_writing = NULL; // being written
+static bool mb_quit = false;
+static bool mb_failed = false; // a write failed: the terminal is gone
+
+// Frames sent and frames replaced before they were, for --stats
+static uint64_t frames_written = 0;
+static uint64_t frames_dropped = 0;
+// Bytes the terminal has accepted and seconds spent waiting for it to; the
+// writer updates both under mb_lock
+static uint64_t sent_bytes = 0;
+static double write_busy = 0;
+
+static void *writer_main(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&mb_lock);
+  for (;;) {
+    while (!mb_pending && !mb_quit)
+      pthread_cond_wait(&mb_cond, &mb_lock);
+    if (!mb_pending)
+      break; // the last frame is out
+    mb_writing = mb_pending;
+    mb_pending = NULL;
+    pthread_mutex_unlock(&mb_lock);
+    double t0 = now_sec();
+    bool ok = write_frame(mb_writing);
+    double dt = now_sec() - t0;
+    pthread_mutex_lock(&mb_lock);
+    sent_bytes += mb_writing->bytes;
+    write_busy += dt;
+    mb_writing->sent = ok;
+    mb_writing = NULL;
+    mb_failed |= !ok;
+    frames_written += ok;
+  }
+  pthread_mutex_unlock(&mb_lock);
+  return NULL;
+}
+
+static void start_writer(void) {
+  async_write = pthread_create(&writer, NULL, writer_main, NULL) == 0;
+}
+
+// Send what is in the mailbox, then stop
+static void stop_writer(void) {
+  if (!async_write)
+    return;
+  pthread_mutex_lock(&mb_lock);
+  mb_quit = true;
+  pthread_cond_signal(&mb_cond);
+  pthread_mutex_unlock(&mb_lock);
+  pthread_join(writer, NULL);
+  async_write = false;
+}
+
+// Start encoding a frame of `parts` parts into a buffer the writer does not
+// hold, with part 0 on this thread
+static void frame_begin(int parts) {
+  if (async_write) {
+    pthread_mutex_lock(&mb_lock);
+    FrameBuf *dropped = mb_pending;
+    mb_pending = NULL;
+    out_frame = mb_writing == &frame_bufs[0] ? &frame_bufs[1] : &frame_bufs[0];
+    if (mb_failed)
+      running = false;
+    pthread_mutex_unlock(&mb_lock);
+
+    size_t cells = (size_t)term_cols * term_rows;
+    if (dropped) {
+      // Back to the screen before the dropped frame
+      frames_dropped++;
+      memcpy(shown, base, cells * sizeof(uint32_t));
+      memcpy(shown_cold, base_cold, term_rows);
+      shown_valid &= !dropped->repaint;
+      screen_clear |= dropped->clears;
+    } else {
+      memcpy(base, shown, cells * sizeof(uint32_t));
+      memcpy(base_cold, shown_cold, term_rows);
+    }
+  }
+  FrameBuf *f = out_frame;
+  if (parts > f->cap) {
+    f->parts = realloc(f->parts, parts * sizeof(*f->parts));
+    memset(f->parts + f->cap, 0, (parts - f->cap) * sizeof(*f->parts));
+    f->cap = parts;
+  }
+  for (int i = 0; i < parts; i++)
+    f->parts[i].count = 0;
+  f->count = parts;
+  f->repaint = f->clears = false;
+  part_begin(0);
+}
 
-void flush_buffer(void) {
-  if (out_buf_len > 0) {
-    write(STDOUT_FILENO, out_buf, out_buf_len);
-    out_buf_len = 0;
+// Finish the frame: gather its parts in order, then send it or post it to
+// the writer thread. Returns the bytes posted, 0 for an empty frame.
+size_t flush_buffer(void) {
+  FrameBuf *f = out_frame;
+  part_end();
+  int chunks = 0;
+  for (int i = 0; i < f->count; i++)
+    chunks += f->parts[i].count;
+  if (!chunks) {
+    f->iov_count = 0;
+    f->bytes = 0;
+    return 0;
+  }
+  if (chunks > f->iov_cap) {
+    f->iov_cap = chunks;
+    f->iov = realloc(f->iov, chunks * sizeof(*f->iov));
+  }
+  f->iov_count = 0;
+  f->bytes = 0;
+  f->sent = false;
+  for (int i = 0; i < f->count; i++) {
+    FramePart *p = &f->parts[i];
+    for (int j = 0; j < p->count; j++) {
+      f->iov[f->iov_count++] = (struct iovec){p->chunks[j], p->iov[j].iov_len};
+      f->bytes += p->iov[j].iov_len;
+    }
+  }
+  if (async_write) {
+    pthread_mutex_lock(&mb_lock);
+    mb_pending = f;
+    pthread_cond_signal(&mb_cond);
+    pthread_mutex_unlock(&mb_lock);
+  } else {
+    double t0 = now_sec();
+    f->sent = write_frame(f);
+    if (f->sent)
+      frames_written++;
+    else
+      running = false; // the terminal is gone
+    write_busy += now_sec() - t0;
+    sent_bytes += f->bytes;
   }
+  f->count = 0;
+  return f->bytes;
 }
 
 void append_to_buffer(const char *str, int len) {
   if (out_buf_len + len >= OUT_BUF_SIZE) {
-    flush_buffer();
+    next_chunk();
   }
   memcpy(out_buf + out_buf_len, str, len);
   out_buf_len += len;
 }
 
-void render(void) {
-  // Move cursor to top-left
-  append_to_buffer("\033[H", 3);
+// Set the background color to that of `intensity`
+static void append_bg(uint8_t intensity) {
+  const EscSlot *e = &esc_cache[truecolor][intensity];
+  append_to_buffer(e->bytes, e->len - 1); // without the space
+}
 
-  char pixel_buf[64];
-  int pixel_len;
+// Paint one cell in the color of `intensity` at the cursor. The background
+// SGR stays in effect across cells, cursor moves and erases, so a cell in
+// the color the terminal already has is just a space. `bg` tracks that color
+// as an esc_color key, -1 while unknown.
+static inline void put_cell(const EscSlot *esc, const uint8_t *color,
+                            uint8_t intensity, int *bg) {
+  if (out_buf_len > OUT_BUF_SIZE - (int)sizeof(EscSlot))
+    next_chunk();
+  // The escape goes out either way; a repeated color turns its first byte
+  // into the space and keeps only that. Run lengths are random in a fire, so
+  // this is arithmetic rather than a mispredicted branch.
+  int same = color[intensity] == *bg;
+  int len = esc[intensity].len;
+  *bg = sgr_runs ? color[intensity] : -1;
+  memcpy(out_buf + out_buf_len, &esc[intensity], sizeof(EscSlot));
+  out_buf[out_buf_len] = (char)('\033' + same * (' ' - '\033'));
+  out_buf_len += len - same * (len - 1);
+}
 
-  // Optimization: Track current active color to avoid redundant escape codes
-  // But since we are doing full screen updates and fire is chaotic,
-  // we might just emit color for every pixel or run length encode.
-  // Given the requirement for "buttery smooth", let's try to be smart.
-  // However, terminal escape codes are long.
-  // A simple optimization is: if the color is black, print a space.
-  // If the color is the same as previous, just print a space (background
-  // color).
+// SGR colors in effect, as esc_color keys, -1 while unknown
+typedef struct {
+  int fg, bg;
+} SgrState;
 
-  // Actually, best visual is using background colors and spaces.
+// Bytes to draw glyph `mask` in colors fg on bg from state s. A glyph with
+// no foreground pixels needs no foreground color, a solid one no background,
+// and both colors in one SGR share the CSI: "\033[38;...;48;...m".
+static inline int glyph_cost(const SgrState *s, int mask, int fg, int bg) {
+  int nf = mask && fg != s->fg;
+  int nb = mask != glyph->solid && bg != s->bg;
+  return glyph_slots[mask].len + nf * fg_cache[truecolor][fg].len +
+         nb * (esc_cache[truecolor][bg].len - 1) - 2 * (nf & nb);
+}
 
-  for (int y = 0; y < height - 1;
-       y++) { // Don't render the very bottom source row
-    for (int x = 0; x < width; x++) {
-      int idx = y * width + x;
-      uint8_t intensity = fire_buffer[idx];
-
-      // Optimization: Skip if identical to previous frame?
-      // Terminals are fast, but sending 2MB/s of text is heavy.
-      // If we skip, we must move cursor. Moving cursor is expensive (escape
-      // code). It is often faster to just overwrite everything than to seek.
-      // BUT, we can optimize by only writing non-black pixels if we cleared
-      // screen? No, fire changes shape.
-
-      // Let's just write everything linearly.
-
-      if (truecolor) {
-        ColorRGB c = palette_rgb[intensity];
-        // \033[48;2;R;G;Bm (set background) + space
-        pixel_len = sprintf(pixel_buf, "\033[48;2;%d;%d;%dm ", c.r, c.g, c.b);
+// Choose how to draw `cell` from state s: as packed, or in modes with a
+// solid glyph as the complement glyph with the colors swapped, whichever
+// needs fewer bytes. Returns that many.
+static inline int glyph_plan(const SgrState *s, uint32_t cell, int *mask,
+                             int *fg, int *bg) {
+  int m = cell_mask(cell), f = cell_fg(cell), b = cell_bg(cell);
+  int cost = glyph_cost(s, m, f, b);
+  if (glyph->solid < 0) {
+    *mask = m;
+    *fg = f;
+    *bg = b;
+    return cost;
+  }
+  // Which one wins is a coin toss in a fire; select without branching
+  int flip = glyph_cost(s, m ^ glyph->solid, b, f);
+  int swap = -(flip < cost); // all ones to take the complement
+  *mask = m ^ (swap & glyph->solid);
+  *fg = f ^ (swap & (f ^ b));
+  *bg = b ^ (swap & (f ^ b));
+  return cost + (swap & (flip - cost));
+}
+
+static inline void sgr_update(SgrState *s, int mask, int fg, int bg) {
+  if (!sgr_runs) {
+    s->fg = s->bg = -1;
+    return;
+  }
+  int nf = -(mask != 0), nb = -(mask != glyph->solid);
+  s->fg ^= nf & (s->fg ^ fg);
+  s->bg ^= nb & (s->bg ^ bg);
+}
+
+// Draw a packed terminal cell at the cursor. Like put_cell() every piece is
+// copied as a whole slot and kept or dropped by how far the output advances.
+static void put_glyph(SgrState *s, uint32_t cell) {
+  int mask, fg, bg;
+  glyph_plan(s, cell, &mask, &fg, &bg);
+  if (out_buf_len >
+      OUT_BUF_SIZE - 2 * (int)sizeof(EscSlot) - (int)sizeof(GlyphSlot))
+    next_chunk();
+  const EscSlot *f = &fg_cache[truecolor][fg];
+  const EscSlot *b = &esc_cache[truecolor][bg];
+  int nf = mask && fg != s->fg;
+  int nb = mask != glyph->solid && bg != s->bg;
+  char *out = out_buf + out_buf_len;
+  // Foreground without its final 'm', which becomes ';' when the background
+  // follows in the same SGR: "\033[38;...;48;...m"
+  memcpy(out, f->bytes, sizeof(EscSlot));
+  out += nf * (f->len - 1);
+  *out = nb ? ';' : 'm';
+  out += nf;
+  // Background without the space, and without its CSI after a foreground
+  memcpy(out, b->bytes + 2 * nf, sizeof(EscSlot) - 2);
+  out += nb * (b->len - 1 - 2 * nf);
+  memcpy(out, &glyph_slots[mask], sizeof(GlyphSlot));
+  out_buf_len = (int)(out - out_buf) + glyph_slots[mask].len;
+  sgr_update(s, mask, fg, bg);
+}
+
+// Draw one terminal cell; full cells take the plain background path
+static inline void put_screen(SgrState *s, uint32_t cell) {
+  if (glyph_mode == GLYPH_FULL)
+    put_cell(esc_cache[truecolor], esc_color[truecolor], cell_bg(cell),
+             &s->bg);
+  else
+    put_glyph(s, cell);
+}
+
+// --- Delta Rendering ---
+//
+// The terminal keeps what it was sent, so a frame only needs the cells that
+// changed. `shown` holds the packed cell of every terminal cell on screen.
+// Changed cells come in spans; to get from the end of one span to the next
+// the renderer either overwrites the unchanged gap (it knows what is there),
+// jumps forward with CUF, or moves with CUP, whichever is fewest bytes.
+
+static bool delta_render = true; // off only to measure it in --bench
+
+static int digits(int v) {
+  int n = 1;
+  while (v >= 10) {
+    v /= 10;
+    n++;
+  }
+  return n;
+}
+
+// Bytes of CUP to row y, column x (0-based), in its shortest form
+static int cup_cost(int y, int x) {
+  return x ? 4 + digits(y + 1) + digits(x + 1) : 3 + digits(y + 1);
+}
+
+static void append_cup(int y, int x) {
+  char buf[32];
+  int len = x ? snprintf(buf, sizeof(buf), "\033[%d;%dH", y + 1, x + 1)
+              : snprintf(buf, sizeof(buf), "\033[%dH", y + 1);
+  append_to_buffer(buf, len);
+}
+
+// Bytes to repaint the unchanged cells row[from, to) starting from state s,
+// or anything above `limit` once it is clear the gap costs more
+static int gap_cost(const uint32_t *row, int from, int to, SgrState s,
+                    int limit) {
+  int cost = 0;
+  for (int x = from; x < to && cost <= limit; x++) {
+    int mask, fg, bg;
+    cost += glyph_plan(&s, row[x], &mask, &fg, &bg);
+    sgr_update(&s, mask, fg, bg);
+  }
+  return cost;
+}
+
+// Cursor as far as the renderer knows; cx is -1 when unknown, e.g. after the
+// last column, where terminals hold a pending wrap
+typedef struct {
+  int cy, cx;
+  SgrState sgr;
+} ScreenCursor;
+
+// Bring the cursor to (y, x) in the cheapest way, given the row on screen
+static void move_to(ScreenCursor *c, const uint32_t *row, int y, int x) {
+  if (c->cy == y && c->cx == x)
+    return;
+  int cup = cup_cost(y, x);
+  // From the row above, LF (OPOST is off, so no CR) keeps the column
+  int lf = c->cy == y ? 0 : c->cy == y - 1 ? 1 : -1;
+  int gap = x - c->cx;
+  if (lf < 0 || c->cx < 0 || gap < 0) {
+    append_cup(y, x);
+  } else {
+    int cuf = gap == 0 ? 0 : gap == 1 ? 3 : 3 + digits(gap);
+    int jump = cup < lf + cuf ? cup : lf + cuf;
+    int over = lf + gap_cost(row, c->cx, x, c->sgr, jump - lf);
+    if (over <= jump || lf + cuf <= cup) {
+      if (lf)
+        append_to_buffer("\n", 1);
+      if (over <= jump) {
+        for (int i = c->cx; i < x; i++)
+          put_screen(&c->sgr, row[i]);
       } else {
-        uint8_t c = palette_256[intensity];
-        pixel_len = sprintf(pixel_buf, "\033[48;5;%dm ", c);
+        char buf[16];
+        append_to_buffer(buf, gap == 1 ? snprintf(buf, sizeof(buf), "\033[C")
+                                       : snprintf(buf, sizeof(buf),
+                                                  "\033[%dC", gap));
+      }
+    } else {
+      append_cup(y, x);
+    }
+  }
+  c->cy = y;
+  c->cx = x;
+}
+
+// Send only the cells of `screen` rows [y0, y1) that differ from `shown`
+static void render_delta(int y0, int y1) {
+  const uint8_t *color = esc_color[truecolor];
+  ScreenCursor c = {.cy = -1, .cx = -1, .sgr = {-1, -1}};
+
+  for (int y = y0; y < y1; y++) {
+    uint32_t *row = shown + (size_t)y * term_cols;
+
+    // A cold row: nothing to do when the screen has it black already,
+    // otherwise one erase (EL 2) in black. Black packs to 0.
+    if (!screen_hot[y]) {
+      if (shown_cold[y])
+        continue;
+      move_to(&c, row, y, 0);
+      if (c.sgr.bg != color[0]) {
+        append_bg(0);
+        c.sgr.bg = color[0];
+      }
+      append_to_buffer("\033[2K", 4);
+      memset(row, 0, term_cols * sizeof(uint32_t));
+      shown_cold[y] = 1;
+      continue;
+    }
+
+    const uint32_t *src = screen + (size_t)y * term_cols;
+    bool cold = true;
+    for (int x = 0; x < term_cols; x++) {
+      cold &= src[x] == 0;
+      if (src[x] == row[x])
+        continue;
+      move_to(&c, row, y, x);
+      put_screen(&c.sgr, src[x]);
+      row[x] = src[x];
+      c.cx = x + 1 < term_cols ? x + 1 : -1;
+    }
+    shown_cold[y] = cold;
+  }
+}
+
+// Start a full repaint. Everything above the flame ceiling is cold: paint it
+// with a single erase (ED 1, from the top of the screen through the cursor)
+// in the background color of intensity 0 instead of one escape per cell.
+static void full_begin(int ceiling) {
+  out_frame->repaint = true;
+  if (screen_clear) {
+    append_to_buffer("\033[2J", 4);
+    out_frame->clears = true;
+    screen_clear = false;
+  }
+  if (ceiling > 0) {
+    char buf[32];
+    append_bg(0);
+    append_to_buffer(buf, snprintf(buf, sizeof(buf), "\033[%d;%dH\033[1J",
+                                   ceiling, term_cols));
+  }
+}
+
+// Paint every cell of rows [y0, y1) below the ceiling, then remember them
+// for the next delta
+static void render_full(int ceiling, int y0, int y1) {
+  const uint8_t *color = esc_color[truecolor];
+  SgrState sgr = {-1, -1}; // the band starts in unknown colors
+  bool need_move = true;
+
+  for (int y = y0 > ceiling ? y0 : ceiling; y < y1; y++) {
+    if (need_move) {
+      append_cup(y, 0);
+      need_move = false;
+    }
+
+    // A cold row below the ceiling: erase the line (EL 2)
+    if (!screen_hot[y]) {
+      if (sgr.bg != color[0]) {
+        append_bg(0);
+        sgr.bg = color[0];
+      }
+      append_to_buffer("\033[2K", 4);
+      need_move = true;
+      continue;
+    }
+
+    // Rows are exactly as wide as the terminal, so the last cell wraps to
+    // the next row on its own. The wrap is pending until a cell is printed,
+    // though: an erase would still hit this row, so a cold row next needs a
+    // move first.
+    const uint32_t *src = screen + (size_t)y * term_cols;
+    for (int x = 0; x < term_cols; x++)
+      put_screen(&sgr, src[x]);
+    need_move = y + 1 < y1 && !screen_hot[y + 1];
+  }
+
+  for (int y = y0; y < y1; y++) {
+    uint32_t *row = shown + (size_t)y * term_cols;
+    bool cold = !screen_hot[y];
+    if (cold) {
+      memset(row, 0, term_cols * sizeof(uint32_t));
+    } else {
+      const uint32_t *src = screen + (size_t)y * term_cols;
+      memcpy(row, src, term_cols * sizeof(uint32_t));
+      cold = true;
+      for (int x = 0; x < term_cols; x++)
+        cold &= src[x] == 0;
+    }
+    shown_cold[y] = cold;
+  }
+}
+
+// 65536 / n rounded up, so sum * recip[n] >> 16 is sum / n for n <= 8
+static const uint32_t recip[9] = {0,     65536, 32768, 21846, 16384,
+                                  13108, 10923, 9363,  8192};
+
+// Reduce the cw x ch heat cells at src (rows `width` apart) to a two-color
+// terminal cell: the cells hotter than the middle of their range take the
+// foreground, and each side shows its mean heat. Called with constant sizes
+// so the loops unroll.
+static inline uint32_t reduce_cell(const uint8_t *src, const uint8_t *color,
+                                   int cw, int ch) {
+  int n = cw * ch;
+  uint8_t px[8];
+  int lo = 255, hi = 0, sum = 0;
+  for (int i = 0; i < n; i++) {
+    px[i] = src[(size_t)(i / cw) * width + i % cw];
+    lo = px[i] < lo ? px[i] : lo;
+    hi = px[i] > hi ? px[i] : hi;
+    sum += px[i];
+  }
+  int mid = (lo + hi) >> 1, mask = 0, fg_sum = 0;
+  for (int i = 0; i < n; i++) {
+    int up = px[i] > mid;
+    mask |= up << i;
+    fg_sum += up * px[i];
+  }
+  int nfg = __builtin_popcount(mask);
+  int fg = color[fg_sum * recip[nfg] >> 16];
+  int bg = color[(sum - fg_sum) * recip[n - nfg] >> 16];
+  // One packing per look, as in the half-block case: no mask for a single
+  // color and, with a solid glyph, bit 0 in the background
+  if (glyph->solid >= 0 && (mask & 1)) {
+    mask ^= glyph->solid;
+    int t = fg;
+    fg = bg;
+    bg = t;
+  }
+  return mask && fg != bg ? cell_pack(mask, fg, bg) : cell_pack(0, bg, bg);
+}
+
+// Reduce rows [y0, y1) of a frame of palette indices to terminal cells in
+// `screen`, each the one packing of its look: no mask when the cell shows a
+// single color, and with a solid glyph bit 0 in the background, so equal
+// looks compare equal. color maps palette indices to esc_color keys.
+static void reduce_rows(const uint8_t *cells, const uint8_t *row_hot,
+                        const uint8_t *color, int y0, int y1) {
+  int ch = glyph->ch;
+  for (int y = y0; y < y1; y++) {
+    bool hot = false;
+    for (int j = 0; j < ch; j++)
+      hot |= row_hot[y * ch + j] != 0;
+    screen_hot[y] = hot;
+    if (!hot)
+      continue; // cold rows are erased, never read
+
+    const uint8_t *src = cells + (size_t)y * ch * width;
+    uint32_t *dst = screen + (size_t)y * term_cols;
+    switch (glyph_mode) {
+    case GLYPH_HALF:
+      // ▀ with the upper color is ▄ with the lower one, and equal colors
+      // leave no mask
+      for (int x = 0; x < term_cols; x++) {
+        int up = color[src[x]], lo = color[src[x + width]];
+        dst[x] = cell_pack((up != lo) * 2, lo, up);
       }
-      append_to_buffer(pixel_buf, pixel_len);
+      break;
+    case GLYPH_FULL:
+      for (int x = 0; x < term_cols; x++)
+        dst[x] = cell_pack(0, color[src[x]], color[src[x]]);
+      break;
+    case GLYPH_QUADRANT:
+      for (int x = 0; x < term_cols; x++)
+        dst[x] = reduce_cell(src + 2 * x, color, 2, 2);
+      break;
+    case GLYPH_SEXTANT:
+      for (int x = 0; x < term_cols; x++)
+        dst[x] = reduce_cell(src + 2 * x, color, 2, 3);
+      break;
+    default:
+      for (int x = 0; x < term_cols; x++)
+        dst[x] = reduce_cell(src + 2 * x, color, 2, 4);
+      break;
     }
-    // Newline at end of row? No, raw mode wraps or we just continue.
-    // Actually, we need to handle wrapping manually or just rely on terminal
-    // width. Safest is explicit newline or move. But if width matches terminal
-    // width, it wraps automatically. Let's assume width matches.
   }
+}
+
+// Frames are encoded in bands of this many terminal rows, each in its own
+// part, in parallel on the simulation's threads. Every band starts with a
+// cursor move and unknown colors, and the split does not depend on the
+// thread count, so the output is the same bytes on any number of threads.
+#define ENCODE_BAND_ROWS 16
+
+typedef struct {
+  const uint8_t *cells, *row_hot;
+  uint8_t color[256]; // palette index to esc_color key, after color_shift
+  int rows, ceiling;  // in terminal rows
+  bool delta;
+} EncodeJob;
+
+static void encode_band(int band, int worker, void *arg) {
+  (void)worker;
+  const EncodeJob *job = arg;
+  int y0 = band * ENCODE_BAND_ROWS, y1 = y0 + ENCODE_BAND_ROWS;
+  if (y1 > job->rows)
+    y1 = job->rows;
+  part_begin(band + 1);
+  reduce_rows(job->cells, job->row_hot, job->color, y0, y1);
+  if (job->delta)
+    render_delta(y0, y1);
+  else
+    render_full(job->ceiling, y0, y1);
+  part_end();
+}
+
+// Draw a frame of palette indices, one per heat cell, width x height
+static size_t render_cells(const uint8_t *cells, const uint8_t *row_hot,
+                           int ceiling) {
+  EncodeJob job = {.cells = cells, .row_hot = row_hot};
+  job.rows = term_rows - 1; // Don't render the very bottom source row
+  job.ceiling = ceiling / glyph->ch;
+  if (job.ceiling > job.rows)
+    job.ceiling = job.rows;
+  for (int i = 0; i < 256; i++)
+    job.color[i] = esc_color[truecolor][i >> color_shift << color_shift];
+  int bands = (job.rows + ENCODE_BAND_ROWS - 1) / ENCODE_BAND_ROWS;
+
+  frame_begin(bands + 2); // head, bands, tail; may take back a repaint
+  job.delta = shown_valid && shown_truecolor == truecolor && delta_render;
+  if (sync_output)
+    append_to_buffer("\033[?2026h", 8);
+  if (!job.delta)
+    full_begin(job.ceiling);
+  part_end();
+  doomfire_parallel(fire, encode_band, &job, bands);
+  shown_valid = true;
+  shown_truecolor = truecolor;
 
   // Reset color at end of frame
+  part_begin(bands + 1);
   append_to_buffer("\033[0m", 4);
-  flush_buffer();
+  if (sync_output)
+    append_to_buffer("\033[?2026l", 8);
+  size_t bytes = flush_buffer();
+  out_frames++;
+  return bytes;
 }
 
-// --- Main ---
+// --- Sixel Output ---
+//
+// Sixel draws a bitmap in bands of six pixel rows. Within a band each color
+// takes one pass over the columns: "#N" selects register N, then one
+// character per column, '?' plus six bits that say which of its pixels are
+// in that color, and "$" returns to the band start for the next color; "-"
+// moves on to the next band. Repeats are "!count" and the character. The
+// fire is palette-indexed already, so heat values are the registers, and a
+// heat cell of pixel_scale pixels square costs nothing extra: its rows are
+// more bits in the same character, its columns a longer run.
 
-int main(void) {
-  srand(time(NULL));
-  init_palette();
-  init_terminal();
+#define SIXEL_CELL_W 10 // pixels per terminal cell when the tty does not say
+#define SIXEL_CELL_H 20
 
-  struct winsize w;
-  ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-  resize_buffers(w.ws_col, w.ws_row);
+typedef struct {
+  uint8_t *planes;   // a row of `width` sixels per color, zero between bands
+  uint16_t *cols;    // per color, the columns it has sixels in, ascending,
+                     // width + 1 apart: the slot after the last is scratch
+  int count[256];    // of cols per color
+  uint8_t used[256]; // colors in the frame so far
+} SixelScratch;
 
-  struct timespec ts;
-  ts.tv_sec = 0;
-  ts.tv_nsec = FRAME_DELAY_NS;
+static SixelScratch *sixel_scratch = NULL; // one per worker
+static int sixel_workers = 0;
+static int sixel_width = 0;
 
-  while (running) {
-    // Check resize
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-    if (w.ws_col != width || w.ws_row != height) {
-      resize_buffers(w.ws_col, w.ws_row);
+static inline char *put_uint(char *p, unsigned v) {
+  if (v < 10) {
+    *p = (char)('0' + v);
+    return p + 1;
+  }
+  if (v < 100) {
+    p[0] = (char)('0' + v / 10);
+    p[1] = (char)('0' + v % 10);
+    return p + 2;
+  }
+  char tmp[10];
+  int n = 0;
+  do {
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (n)
+    *p++ = tmp[--n];
+  return p;
+}
+
+// n columns of sixel character `c`
+static inline void put_run(char c, int n) {
+  if (out_buf_len > OUT_BUF_SIZE - 16)
+    next_chunk();
+  char *p = out_buf + out_buf_len;
+  if (n > 3) {
+    *p++ = '!';
+    p = put_uint(p, n);
+    *p++ = c;
+  } else {
+    memset(p, c, 3);
+    p += n;
+  }
+  out_buf_len = (int)(p - out_buf);
+}
+
+// Select register `color`, after returning to the band start unless `first`
+static inline void put_register(int color, bool first) {
+  if (out_buf_len > OUT_BUF_SIZE - 16)
+    next_chunk();
+  char *p = out_buf + out_buf_len;
+  *p = '$';
+  p += !first;
+  *p++ = '#';
+  out_buf_len = (int)(put_uint(p, color) - out_buf);
+}
+
+typedef struct {
+  const uint8_t *cells;
+  uint8_t color[256]; // heat to register, after color_shift
+  int bands;
+} SixelJob;
+
+// Encode sixel band `band` into its part of the frame
+static void sixel_band(int band, int worker, void *arg) {
+  const SixelJob *job = arg;
+  SixelScratch *s = &sixel_scratch[worker];
+  int scale = pixel_scale, rows = 6 / scale;
+  const uint8_t *src = job->cells + (size_t)band * rows * width;
+
+  // Sort the band's pixels into one sixel row per color, column by column,
+  // and note each color's columns as they come up, so the encoding below
+  // only visits the sixels a color has rather than scan its whole row
+  for (int x = 0; x < width; x++)
+    for (int j = 0; j < rows; j++) {
+      int c = job->color[src[(size_t)j * width + x]];
+      uint8_t *sixel = &s->planes[(size_t)c * width + x];
+      s->cols[(size_t)c * (width + 1) + s->count[c]] = (uint16_t)x;
+      s->count[c] += !*sixel;
+      *sixel |= (uint8_t)(((1 << scale) - 1) << (j * scale));
     }
 
-    update_fire();
-    render();
+  part_begin(band + 1);
+  bool first = true;
+  for (int c = 0; c < 256; c++) {
+    int count = s->count[c];
+    if (!count)
+      continue;
+    s->used[c] = 1;
+    s->count[c] = 0;
+    put_register(c, first);
+    first = false;
+    uint8_t *plane = s->planes + (size_t)c * width;
+    const uint16_t *cols = s->cols + (size_t)c * (width + 1);
+    // Runs of equal sixels, with the columns between listed ones empty
+    int prev = 0, n = 0, next = 0;
+    for (int k = 0; k < count; k++) {
+      int x = cols[k], v = plane[x];
+      plane[x] = 0;
+      if (x != next || v != prev) {
+        if (n)
+          put_run((char)('?' + prev), n * scale);
+        if (x != next)
+          put_run('?', (x - next) * scale);
+        prev = v;
+        n = 0;
+      }
+      n++;
+      next = x + 1;
+    }
+    put_run((char)('?' + prev), n * scale);
+  }
+  if (band + 1 < job->bands)
+    append_to_buffer("-", 1);
+  part_end();
+}
 
-    nanosleep(&ts, NULL);
+// Draw a frame of palette indices as one sixel image at the top left
+static size_t render_sixel(const uint8_t *cells) {
+  int workers = doomfire_config(fire)->threads;
+  if (workers != sixel_workers || width != sixel_width) {
+    for (int i = 0; i < sixel_workers; i++) {
+      free(sixel_scratch[i].planes);
+      free(sixel_scratch[i].cols);
+    }
+    free(sixel_scratch);
+    sixel_scratch = calloc(workers, sizeof(*sixel_scratch));
+    for (int i = 0; i < workers; i++) {
+      sixel_scratch[i].planes = calloc(256, width);
+      sixel_scratch[i].cols = malloc(256 * (width + 1) * sizeof(uint16_t));
+    }
+    sixel_workers = workers;
+    sixel_width = width;
   }
+  for (int i = 0; i < workers; i++)
+    memset(sixel_scratch[i].used, 0, 256);
 
-  return 0;
-}
+  SixelJob job = {.cells = cells};
+  job.bands = (height - 1) * pixel_scale / 6;
+  for (int i = 0; i < 256; i++)
+    job.color[i] = (uint8_t)(i >> color_shift << color_shift);
+
+  frame_begin(job.bands + 2); // head, bands, tail
+  part_end();
+  doomfire_parallel(fire, sixel_band, &job, job.bands);
+
+  // The head defines the registers the bands used, so it comes last
+  char buf[64];
+  part_begin(0);
+  out_frame->repaint = true;
+  if (sync_output)
+    append_to_buffer("\033[?2026h", 8);
+  if (screen_clear) {
+    append_to_buffer("\033[2J", 4);
+    out_frame->clears = true;
+    screen_clear = false;
+  }
+  append_to_buffer(buf, snprintf(buf, sizeof(buf), "\033[H\033P0;1q\"1;1;%d;%d",
+                                 width * pixel_scale,
+                                 (height - 1) * pixel_scale));
+  for (int c = 0; c < 256; c++) {
+    uint8_t used = 0;
+    for (int i = 0; i < workers; i++)
+      used |= sixel_scratch[i].used[c];
+    if (used)
+      append_to_buffer(sixel_regs[c].bytes, sixel_regs[c].len);
+  }
+  part_end();
+
+  part_begin(job.bands + 1);
+  append_to_buffer("\033\\", 2);
+  if (sync_output)
+    append_to_buffer("\033[?2026l", 8);
+  size_t bytes = flush_buffer();
+  out_frames++;
+  return bytes;
+}
+
+// Pixels per terminal cell for bitmaps, from the tty if it reports them
+static void set_cell_pixels(const struct winsize *w) {
+  bool known = w->ws_col && w->ws_row && w->ws_xpixel && w->ws_ypixel;
+  cell_px_w = known ? w->ws_xpixel / w->ws_col : SIXEL_CELL_W;
+  cell_px_h = known ? w->ws_ypixel / w->ws_row : SIXEL_CELL_H;
+}
+
+// --- Kitty Graphics ---
+//
+// The kitty graphics protocol takes whole images in an APC escape,
+// "\033_Gkey=value,...;payload\033\\". With t=s the payload is only the
+// base64 name of a POSIX shared memory object holding the RGBA pixels, so a
+// frame costs the tty a few dozen bytes. The terminal unlinks an object once
+// it has read it, so each frame sent needs a new one. Every frame buffer
+// owns one object at a time and fills it only while its name has not gone
+// out; a dropped frame's object is filled again for the next frame. The
+// terminal never reads an object that is being written. It replies to each
+// frame once it has taken it, and while KITTY_IN_FLIGHT frames have no reply
+// new ones are skipped, so no more objects than that wait on a slow
+// terminal; any still listed are unlinked on exit. Where shared memory is
+// out (a remote terminal) the pixels go inline as base64 RGB in chunks,
+// without replies. Either way the terminal scales the image over the cells.
+
+#define KITTY_CHUNK 4096 // base64 bytes per escape
+#define KITTY_IN_FLIGHT 16
+
+typedef struct {
+  char name[32]; // "/fire-PID-N", empty when there is no object
+  uint8_t *pixels;
+  size_t size;
+} KittyShm;
+
+static KittyShm kitty_shm[2]; // of frame_bufs[0] and [1]
+static char kitty_sent[KITTY_IN_FLIGHT][32]; // names of sent objects
+static unsigned kitty_sent_count = 0;
+static bool kitty_use_shm = false;
+static unsigned kitty_seq = 0;
+static uint8_t *kitty_pixels = NULL; // RGB for inline frames
+static size_t kitty_pixels_size = 0;
+static uint64_t kitty_acked = 0; // frames the terminal has replied to
+static int kitty_reply_at = 0;   // of kitty_reply matched so far
+
+static const char kitty_reply[] = "\033_Gi=1";
+
+static const char base64_digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int base64_encode(const uint8_t *src, size_t n, char *out) {
+  char *p = out;
+  for (; n >= 3; n -= 3, src += 3) {
+    uint32_t v = (uint32_t)src[0] << 16 | src[1] << 8 | src[2];
+    p[0] = base64_digits[v >> 18];
+    p[1] = base64_digits[v >> 12 & 63];
+    p[2] = base64_digits[v >> 6 & 63];
+    p[3] = base64_digits[v & 63];
+    p += 4;
+  }
+  if (n) {
+    uint32_t v = (uint32_t)src[0] << 16 | (n > 1 ? src[1] << 8 : 0);
+    p[0] = base64_digits[v >> 18];
+    p[1] = base64_digits[v >> 12 & 63];
+    p[2] = n > 1 ? base64_digits[v >> 6 & 63] : '=';
+    p[3] = '=';
+    p += 4;
+  }
+  return (int)(p - out);
+}
+
+// Replace k's object with a new one of `size` bytes. The old one is the
+// terminal's to unlink if it was sent, ours otherwise.
+static bool kitty_shm_create(KittyShm *k, size_t size, bool sent) {
+  if (k->pixels)
+    munmap(k->pixels, k->size);
+  if (k->name[0] && sent) {
+    char *old = kitty_sent[kitty_sent_count++ % KITTY_IN_FLIGHT];
+    if (old[0])
+      shm_unlink(old);
+    memcpy(old, k->name, sizeof(k->name));
+  } else if (k->name[0]) {
+    shm_unlink(k->name);
+  }
+  k->pixels = NULL;
+  k->size = 0;
+  snprintf(k->name, sizeof(k->name), "/fire-%d-%u", (int)getpid(),
+           kitty_seq++);
+  int fd = shm_open(k->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    k->name[0] = 0;
+    return false;
+  }
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(k->name);
+    k->name[0] = 0;
+    return false;
+  }
+  k->pixels = p;
+  k->size = size;
+  return true;
+}
+
+// Unlink what is left on exit, sent or not: the terminal is done with it
+static void kitty_shm_release(void) {
+  for (int i = 0; i < 2; i++) {
+    if (kitty_shm[i].name[0])
+      shm_unlink(kitty_shm[i].name);
+    kitty_shm[i].name[0] = 0;
+  }
+  for (int i = 0; i < KITTY_IN_FLIGHT; i++) {
+    if (kitty_sent[i][0])
+      shm_unlink(kitty_sent[i]);
+    kitty_sent[i][0] = 0;
+  }
+}
+
+// Ask the terminal to load a 1x1 image from shared memory (a=q only checks)
+static bool probe_kitty_shm(void) {
+  KittyShm k = {0};
+  if (!kitty_shm_create(&k, 3, false))
+    return false;
+  memset(k.pixels, 0, 3);
+  char query[128], name[48];
+  name[base64_encode((const uint8_t *)k.name, strlen(k.name), name)] = 0;
+  snprintf(query, sizeof(query), "\033_Gi=31,s=1,v=1,a=q,t=s,f=24;%s\033\\",
+           name);
+  char buf[256];
+  probe_terminal(query, buf, sizeof(buf));
+  munmap(k.pixels, k.size);
+  shm_unlink(k.name); // unless the terminal has
+  return strstr(buf, "\033_Gi=31;OK") != NULL;
+}
+
+// Count replies to image 1 ("\033_Gi=1,p=1;OK\033\\" or an error) in what
+// the terminal has sent; the rest of the input is ignored as always
+static void kitty_read_replies(void) {
+  struct pollfd p = {.fd = STDIN_FILENO, .events = POLLIN};
+  char buf[256];
+  ssize_t n;
+  while (poll(&p, 1, 0) > 0 && (n = read(STDIN_FILENO, buf, sizeof(buf))) > 0)
+    for (ssize_t i = 0; i < n; i++) {
+      if (kitty_reply_at == sizeof(kitty_reply) - 1) {
+        kitty_acked += buf[i] == ',' || buf[i] == ';';
+        kitty_reply_at = 0;
+      } else if (buf[i] == kitty_reply[kitty_reply_at]) {
+        kitty_reply_at++;
+      } else {
+        kitty_reply_at = buf[i] == '\033';
+      }
+    }
+}
+
+// Frames sent that the terminal has not replied to
+static uint64_t kitty_in_flight(void) {
+  kitty_read_replies();
+  pthread_mutex_lock(&mb_lock);
+  uint64_t written = frames_written;
+  pthread_mutex_unlock(&mb_lock);
+  return written > kitty_acked ? written - kitty_acked : 0;
+}
+
+typedef struct {
+  const uint8_t *cells;
+  uint8_t *pixels;
+  uint8_t color[256]; // heat after color_shift
+  int bpp;            // 4 for RGBA, 3 for RGB
+} KittyJob;
+
+#define KITTY_BAND_ROWS 16
+
+static void kitty_band(int band, int worker, void *arg) {
+  (void)worker;
+  const KittyJob *job = arg;
+  int y0 = band * KITTY_BAND_ROWS, y1 = y0 + KITTY_BAND_ROWS;
+  if (y1 > height - 1)
+    y1 = height - 1;
+  const uint8_t *src = job->cells + (size_t)y0 * width;
+  uint8_t *dst = job->pixels + (size_t)y0 * width * job->bpp;
+  size_t n = (size_t)(y1 - y0) * width;
+  if (job->bpp == 4)
+    for (size_t i = 0; i < n; i++, dst += 4)
+      memcpy(dst, kitty_rgba[job->color[src[i]]], 4);
+  else
+    for (size_t i = 0; i < n; i++, dst += 3)
+      memcpy(dst, kitty_rgba[job->color[src[i]]], 3);
+}
+
+// Draw a frame of palette indices as one kitty image over the terminal
+static size_t render_kitty(const uint8_t *cells) {
+  if (kitty_use_shm && kitty_in_flight() >= KITTY_IN_FLIGHT) {
+    frames_dropped++; // the terminal is behind, it gets the next one
+    return 0;
+  }
+  frame_begin(1);
+  KittyShm *k = &kitty_shm[out_frame - frame_bufs];
+  size_t rgba = (size_t)width * (height - 1) * 4;
+  if (kitty_use_shm && (out_frame->sent || !k->name[0] || k->size != rgba))
+    kitty_use_shm = kitty_shm_create(k, rgba, out_frame->sent);
+
+  KittyJob job = {.cells = cells, .bpp = kitty_use_shm ? 4 : 3};
+  for (int i = 0; i < 256; i++)
+    job.color[i] = (uint8_t)(i >> color_shift << color_shift);
+  if (kitty_use_shm) {
+    job.pixels = k->pixels;
+  } else {
+    size_t size = (size_t)width * (height - 1) * 3;
+    if (size > kitty_pixels_size) {
+      free(kitty_pixels);
+      kitty_pixels = malloc(size);
+      kitty_pixels_size = size;
+    }
+    job.pixels = kitty_pixels;
+  }
+  doomfire_parallel(fire, kitty_band, &job,
+                    (height - 1 + KITTY_BAND_ROWS - 1) / KITTY_BAND_ROWS);
+
+  char buf[256];
+  out_frame->repaint = true;
+  if (sync_output)
+    append_to_buffer("\033[?2026h", 8);
+  if (screen_clear) {
+    append_to_buffer("\033[2J", 4);
+    out_frame->clears = true;
+    screen_clear = false;
+  }
+  // Image 1 in placement 1, replaced every frame, scaled over the cells,
+  // without moving the cursor
+  int len = snprintf(buf, sizeof(buf),
+                     "\033[H\033_Ga=T,i=1,p=1,s=%d,v=%d,c=%d,r=%d,C=1,",
+                     width, height - 1, term_cols, term_rows - 1);
+  if (kitty_use_shm) {
+    len += snprintf(buf + len, sizeof(buf) - len, "f=32,t=s,S=%zu;", rgba);
+    len += base64_encode((const uint8_t *)k->name, strlen(k->name), buf + len);
+    append_to_buffer(buf, len);
+    append_to_buffer("\033\\", 2);
+  } else {
+    // RGB, a quarter fewer bytes; m=1 on every chunk but the last
+    len += snprintf(buf + len, sizeof(buf) - len, "f=24,q=2,");
+    size_t size = (size_t)width * (height - 1) * 3;
+    size_t step = KITTY_CHUNK / 4 * 3; // pixel bytes per chunk
+    for (size_t at = 0; at < size; at += step) {
+      size_t n = size - at < step ? size - at : step;
+      len += snprintf(buf + len, sizeof(buf) - len, "m=%d;", at + n < size);
+      append_to_buffer(buf, len);
+      if (out_buf_len > OUT_BUF_SIZE - KITTY_CHUNK - 2)
+        next_chunk();
+      out_buf_len += base64_encode(job.pixels + at, n, out_buf + out_buf_len);
+      append_to_buffer("\033\\", 2);
+      len = snprintf(buf, sizeof(buf), "\033_G");
+    }
+  }
+  if (sync_output)
+    append_to_buffer("\033[?2026l", 8);
+  size_t bytes = flush_buffer();
+  out_frames++;
+  return bytes;
+}
+
+// Draw the current fire. Returns the bytes sent or posted for it, 0 when
+// the frame was skipped or had nothing to send.
+size_t render(void) {
+  const uint8_t *cells = doomfire_heat(fire);
+  if (fire_cfg.heat16) {
+    // 16-bit heat: the palette index is the high byte
+    const uint16_t *heat = doomfire_heat16(fire);
+    for (int i = 0; i < width * height; i++)
+      frame_cells[i] = doomfire_heat16_index(heat[i]);
+    cells = frame_cells;
+  }
+  if (backend == BACKEND_SIXEL)
+    return render_sixel(cells);
+  if (backend == BACKEND_KITTY)
+    return render_kitty(cells);
+  return render_cells(cells, doomfire_row_hot(fire), doomfire_ceiling(fire));
+}
+
+// --- Screen Check ---
+//
+// The screen model as an oracle. After each frame every heat cell must show
+// its palette color after color_shift: full and half block cells are held
+// against the heat itself. Quadrant, sextant and braille cells can only
+// show two colors, so there each heat cell must show the color of its side
+// of the two-color reduction.
+
+// What the model holds for esc_color key k
+static int32_t vt_color(int k) {
+  DoomFireRGB c = palette_rgb[k];
+  return truecolor ? VT_RGB | c.r << 16 | c.g << 8 | c.b : palette_256[k];
+}
+
+typedef struct {
+  uint32_t cp;
+  int mask;
+} VtGlyph;
+
+static int compare_vt_glyph(const void *a, const void *b) {
+  uint32_t x = ((const VtGlyph *)a)->cp, y = ((const VtGlyph *)b)->cp;
+  return (x > y) - (x < y);
+}
+
+// Terminal cells in rows [0, term_rows - 1) of s that do not show `cells`,
+// a frame of palette indices
+static int vt_check(const VtScreen *s, const uint8_t *cells) {
+  if (s->cols != term_cols || s->rows != term_rows)
+    return term_cols * term_rows;
+  int n = glyph->cw * glyph->ch;
+  VtGlyph glyphs[256];
+  for (int m = 0; m < 1 << n; m++)
+    glyphs[m] = (VtGlyph){glyph_codepoint(glyph_mode, m), m};
+  qsort(glyphs, 1 << n, sizeof(VtGlyph), compare_vt_glyph);
+  uint8_t color[256];
+  for (int i = 0; i < 256; i++)
+    color[i] = esc_color[truecolor][i >> color_shift << color_shift];
+
+  int bad = 0;
+  for (int y = 0; y < term_rows - 1; y++)
+    for (int x = 0; x < term_cols; x++) {
+      const VtCell *c = &s->cells[(size_t)y * s->cols + x];
+      VtGlyph key = {c->cp, 0};
+      const VtGlyph *g = bsearch(&key, glyphs, 1 << n, sizeof(VtGlyph),
+                                 compare_vt_glyph);
+      const uint8_t *src =
+          cells + (size_t)y * glyph->ch * width + x * glyph->cw;
+      uint32_t two = n > 2 ? reduce_cell(src, color, glyph->cw, glyph->ch) : 0;
+      bool ok = g != NULL;
+      for (int i = 0; ok && i < n; i++) {
+        int want = n <= 2                         ? color[src[i * width]]
+                   : cell_mask(two) >> i & 1 ? cell_fg(two)
+                                             : cell_bg(two);
+        ok = (g->mask >> i & 1 ? c->fg : c->bg) == vt_color(want);
+      }
+      bad += !ok;
+    }
+  return bad;
+}
+
+// Step and render `frames` frames through s, checking each; returns the
+// frames that did not show right
+static int vt_render(VtScreen *s, int frames) {
+  VtScreen *user = out_model;
+  out_model = s;
+  int bad = 0;
+  for (int i = 0; i < frames; i++) {
+    doomfire_step(fire);
+    render();
+    bad += vt_check(s, fire_cfg.heat16 ? frame_cells : doomfire_heat(fire)) >
+           0;
+  }
+  out_model = user;
+  return bad;
+}
+
+// --- Benchmark ---
+
+// Time `frames` simulation steps on a fresh grid, returns seconds
+static double time_update(int frames) {
+  doomfire_reset(fire);
+  for (int i = 0; i < 30; i++) // warm up, let the flames reach full height
+    doomfire_step(fire);
+  double t0 = now_sec();
+  for (int i = 0; i < frames; i++)
+    doomfire_step(fire);
+  return now_sec() - t0;
+}
+
+static uint64_t hash_buffer(const uint8_t *p, size_t n) {
+  uint64_t h = 0xCBF29CE484222325ull; // FNV-1a
+  for (size_t i = 0; i < n; i++)
+    h = (h ^ p[i]) * 0x100000001B3ull;
+  return h;
+}
+
+// Flame shape averaged over `frames` steps: mean heat, share of lit cells,
+// mean visible height (topmost cell above 32) per column in rows, and the
+// share of cells the active-region tracking skipped
+static void flame_stats(int frames, double out[4]) {
+  doomfire_reset(fire);
+  for (int i = 0; i < 2 * height; i++)
+    doomfire_step(fire);
+  double sum = 0, lit = 0, top = 0;
+  uint64_t skipped = doomfire_stats(fire)->cells_skipped;
+  for (int i = 0; i < frames; i++) {
+    doomfire_step(fire);
+    const uint8_t *heat = doomfire_heat(fire);
+    for (int x = 0; x < width; x++) {
+      int top_y = height;
+      for (int y = height - 1; y >= 0; y--) {
+        uint8_t v = heat_index(heat, y * width + x);
+        sum += v;
+        lit += v > 0;
+        if (v > 32)
+          top_y = y;
+      }
+      top += height - top_y;
+    }
+  }
+  double cells = (double)width * height * frames;
+  out[0] = sum / cells;
+  out[1] = lit / cells;
+  out[2] = top / ((double)width * frames);
+  out[3] = (doomfire_stats(fire)->cells_skipped - skipped) / cells;
+}
+
+// Terminal encoding cost and output size of full repaints in both color
+// modes, with one SGR per cell and per run of same-color cells, then the
+// speedup of encoding bands on more threads. Frames go to /dev/null so no
+// terminal is involved; only render() is timed.
+static void bench_render(int frames, int max_threads) {
+  int user_fd = out_fd;
+  bool user_truecolor = truecolor;
+  GlyphMode user_glyph = glyph_mode;
+  int cols = term_cols, rows = term_rows;
+  out_fd = open("/dev/null", O_WRONLY);
+  delta_render = false;
+  printf("render %dx%d terminal, %d frames\n", cols, rows, frames);
+  for (int k = 0; k < 2 * GLYPH_COUNT; k++) {
+    int m = k / 2, tc = !(k % 2);
+    if (tc) {
+      set_glyph_mode(m);
+      resize_buffers(cols, rows);
+    }
+    truecolor = tc;
+    double base = 0;
+    for (int runs = 0; runs < 2; runs++) {
+      sgr_runs = runs;
+      doomfire_reset(fire);
+      for (int i = 0; i < 2 * height; i++) // flames at full height
+        doomfire_step(fire);
+      uint64_t bytes = out_bytes;
+      double dt = 0;
+      for (int i = 0; i < frames; i++) {
+        doomfire_step(fire);
+        double t0 = now_sec();
+        render();
+        dt += now_sec() - t0;
+      }
+      double per_frame = (double)(out_bytes - bytes) / frames;
+      if (!runs)
+        base = per_frame;
+      // ns per terminal cell, bytes per heat cell on screen
+      char name[32];
+      snprintf(name, sizeof(name), "%s %s %s", glyph_names[m],
+               tc ? "truecolor" : "256-color", runs ? "runs" : "cells");
+      printf("  %-24s %6.2f ns/cell %8.0f bytes/frame %5.2f B/px %5.2fx\n",
+             name, dt * 1e9 / ((double)cols * (rows - 1) * frames),
+             per_frame, per_frame / ((double)width * (height - 1)),
+             base / per_frame);
+    }
+  }
+
+  // Bands are split the same way on any number of threads, so the frames
+  // must come out the same bytes
+  set_glyph_mode(user_glyph);
+  resize_buffers(cols, rows);
+  truecolor = user_truecolor;
+  printf("encode threads, %s %s\n", glyph_names[glyph_mode],
+         truecolor ? "truecolor" : "256-color");
+  int user_threads = fire_cfg.threads;
+  double base = 0;
+  uint64_t ref = 0;
+  for (int t = 1; t <= max_threads; t++) {
+    fire_cfg.threads = t;
+    create_fire();
+    for (int i = 0; i < 2 * height; i++)
+      doomfire_step(fire);
+    uint64_t sum = 0;
+    double dt = 0;
+    for (int i = 0; i < frames; i++) {
+      doomfire_step(fire);
+      double t0 = now_sec();
+      render();
+      dt += now_sec() - t0;
+      for (int j = 0; j < out_frame->iov_count; j++)
+        sum = sum * 31 + hash_buffer(out_frame->iov[j].iov_base,
+                                     out_frame->iov[j].iov_len);
+    }
+    double ns = dt * 1e9 / ((double)cols * (rows - 1) * frames);
+    if (t == 1) {
+      ref = sum;
+      base = ns;
+    }
+    printf("  %3d %6.2f ns/cell %5.2fx  %s\n", doomfire_config(fire)->threads,
+           ns, base / ns, sum == ref ? "ok" : "MISMATCH");
+  }
+  fire_cfg.threads = user_threads;
+  create_fire();
+
+  close(out_fd);
+  out_fd = user_fd;
+  truecolor = user_truecolor;
+  set_glyph_mode(user_glyph);
+  resize_buffers(cols, rows);
+  sgr_runs = true;
+  delta_render = true;
+}
+
+// Sixel against SGR text on the terminal grid: encode time and bytes per
+// frame and per heat cell, with a heat cell per pixel (plus the register
+// count cut by dropping heat bits) and per 2x2 pixels
+static void bench_sixel(int frames) {
+  static const struct {
+    Backend backend;
+    GlyphMode glyph;
+    int scale, shift;
+  } cases[] = {{BACKEND_TEXT, GLYPH_FULL, 1, 0},
+               {BACKEND_TEXT, GLYPH_HALF, 1, 0},
+               {BACKEND_SIXEL, GLYPH_FULL, 1, 0},
+               {BACKEND_SIXEL, GLYPH_FULL, 1, 2},
+               {BACKEND_SIXEL, GLYPH_FULL, 2, 0}};
+  int user_fd = out_fd;
+  bool user_truecolor = truecolor;
+  GlyphMode user_glyph = glyph_mode;
+  int user_scale = pixel_scale;
+  int cols = term_cols, rows = term_rows;
+  out_fd = open("/dev/null", O_WRONLY);
+  delta_render = false;
+  truecolor = true;
+  printf("sixel vs sgr, %dx%d terminal, %d frames, full repaints\n", cols,
+         rows, frames);
+  double sgr = 0;
+  for (int k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++) {
+    backend = cases[k].backend;
+    pixel_scale = cell_px_w = cell_px_h = cases[k].scale;
+    color_shift = cases[k].shift;
+    set_glyph_mode(cases[k].glyph);
+    resize_buffers(cols, rows);
+    doomfire_reset(fire);
+    for (int i = 0; i < 2 * height; i++)
+      doomfire_step(fire);
+    uint64_t bytes = out_bytes;
+    double dt = 0;
+    for (int i = 0; i < frames; i++) {
+      doomfire_step(fire);
+      double t0 = now_sec();
+      render();
+      dt += now_sec() - t0;
+    }
+    double px = (double)width * (height - 1);
+    double per_frame = (double)(out_bytes - bytes) / frames;
+    if (!k)
+      sgr = per_frame / px;
+    char name[32];
+    if (backend == BACKEND_TEXT)
+      snprintf(name, sizeof(name), "sgr %s runs", glyph_names[glyph_mode]);
+    else
+      snprintf(name, sizeof(name), "sixel %dx%d px, %d colors", pixel_scale,
+               pixel_scale, 256 >> color_shift);
+    printf("  %-24s %6.2f ns/px %8.0f bytes/frame %5.2f B/px %5.2fx\n", name,
+           dt * 1e9 / (px * frames), per_frame, per_frame / px,
+           sgr / (per_frame / px));
+  }
+  close(out_fd);
+  out_fd = user_fd;
+  truecolor = user_truecolor;
+  backend = BACKEND_TEXT;
+  pixel_scale = user_scale;
+  color_shift = 0;
+  set_glyph_mode(user_glyph);
+  resize_buffers(cols, rows);
+  delta_render = true;
+}
+
+// Time the kitty frames on this thread, from the cells to bytes for the
+// writer: a new shared memory object per frame, or inline base64. The
+// terminal's part, unlinking each object and replying, is done here too.
+static void bench_kitty(int frames) {
+  int user_fd = out_fd;
+  int user_scale = pixel_scale;
+  int cols = term_cols, rows = term_rows;
+  out_fd = open("/dev/null", O_WRONLY);
+  backend = BACKEND_KITTY;
+  pixel_scale = cell_px_w = cell_px_h = 1;
+  resize_buffers(cols, rows);
+  printf("kitty, %dx%d image, %d frames\n", width, height - 1, frames);
+  for (int shm = 1; shm >= 0; shm--) {
+    kitty_use_shm = shm;
+    doomfire_reset(fire);
+    for (int i = 0; i < 2 * height; i++)
+      doomfire_step(fire);
+    uint64_t bytes = out_bytes;
+    double dt = 0;
+    for (int i = 0; i < frames; i++) {
+      doomfire_step(fire);
+      double t0 = now_sec();
+      render();
+      dt += now_sec() - t0;
+      KittyShm *k = &kitty_shm[out_frame - frame_bufs];
+      if (k->name[0])
+        shm_unlink(k->name);
+      kitty_acked = frames_written;
+    }
+    double px = (double)width * (height - 1);
+    printf("  %-24s %6.2f ns/px %8.0f us/frame %8.0f bytes/frame\n",
+           shm ? "shared memory (t=s)" : "inline base64 (f=24)",
+           dt * 1e9 / (px * frames), dt * 1e6 / frames,
+           (double)(out_bytes - bytes) / frames);
+    if (shm && !kitty_use_shm)
+      printf("  (no shared memory here, that was inline too)\n");
+  }
+  kitty_shm_release();
+  close(out_fd);
+  out_fd = user_fd;
+  backend = BACKEND_TEXT;
+  pixel_scale = user_scale;
+  resize_buffers(cols, rows);
+}
+
+// What the terminal does for each text encoding, from the screen model:
+// cells printed and erased per frame against the cells that changed, so
+// encodings can be compared by the work they leave to the terminal as well
+// as by bytes. Every frame is checked against the heat.
+static void bench_screen(int frames) {
+  static const struct {
+    GlyphMode glyph;
+    bool delta, runs;
+  } cases[] = {{GLYPH_FULL, true, true},      {GLYPH_FULL, false, true},
+               {GLYPH_FULL, true, false},     {GLYPH_HALF, true, true},
+               {GLYPH_HALF, false, true},     {GLYPH_QUADRANT, true, true},
+               {GLYPH_SEXTANT, true, true},   {GLYPH_BRAILLE, true, true}};
+  int user_fd = out_fd;
+  GlyphMode user_glyph = glyph_mode;
+  int cols = term_cols, rows = term_rows;
+  out_fd = open("/dev/null", O_WRONLY);
+  VtScreen model = {0};
+  printf("terminal work %dx%d, %d frames, per frame\n", cols, rows, frames);
+  printf("  %-24s %9s %9s %9s %9s\n", "", "bytes", "printed", "erased",
+         "changed");
+  for (int k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++) {
+    set_glyph_mode(cases[k].glyph);
+    resize_buffers(cols, rows);
+    delta_render = cases[k].delta;
+    sgr_runs = cases[k].runs;
+    doomfire_reset(fire);
+    for (int i = 0; i < 2 * height; i++)
+      doomfire_step(fire);
+    vt_resize(&model, term_cols, term_rows);
+    vt_render(&model, 1); // the first frame of a delta run repaints
+    model.bytes = model.painted = model.erased = model.changed = 0;
+    int bad = vt_render(&model, frames);
+    char name[32];
+    snprintf(name, sizeof(name), "%s %s%s", glyph_names[glyph_mode],
+             delta_render ? "delta" : "repaint", sgr_runs ? "" : ", no runs");
+    printf("  %-24s %9.0f %9.0f %9.0f %9.0f  %s\n", name,
+           (double)model.bytes / frames, (double)model.painted / frames,
+           (double)model.erased / frames, (double)model.changed / frames,
+           bad || model.unknown ? "MISMATCH" : "ok");
+  }
+  free(model.cells);
+  close(out_fd);
+  out_fd = user_fd;
+  delta_render = true;
+  sgr_runs = true;
+  set_glyph_mode(user_glyph);
+  resize_buffers(cols, rows);
+}
+
+// Bytes per frame of full repaints against delta updates, on synthetic
+// frames where `churn` percent of the cells change color between frames (a
+// snapshot of the fire, randomly repainted) and on the running fire
+static void bench_delta(int frames) {
+  static const int churn[] = {0, 1, 5, 20, 50, 100};
+  int nchurn = (int)(sizeof(churn) / sizeof(churn[0]));
+  int user_fd = out_fd;
+  out_fd = open("/dev/null", O_WRONLY);
+  size_t n = (size_t)width * height;
+  size_t visible = (size_t)width * (height - 1);
+  uint8_t *snapshot = malloc(n), *cells = malloc(n), *hot = malloc(height);
+  memset(hot, 1, height);
+  doomfire_reset(fire);
+  for (int i = 0; i < 2 * height; i++) // flames at full height
+    doomfire_step(fire);
+  for (size_t i = 0; i < n; i++)
+    snapshot[i] = heat_index(doomfire_heat(fire), i);
+
+  printf("delta render %dx%d, %s, %d frames, bytes/frame\n", width, height,
+         truecolor ? "truecolor" : "256-color", frames);
+  for (int c = 0; c <= nchurn; c++) {
+    double bytes[2];
+    for (int delta = 0; delta < 2; delta++) {
+      delta_render = delta;
+      shown_valid = false;
+      FireRng rng;
+      fire_rng_seed(&rng, FIRE_RNG_XOSHIRO, 1, c);
+      memcpy(cells, snapshot, n);
+      doomfire_reset(fire);
+      for (int i = 0; i < 2 * height; i++)
+        doomfire_step(fire);
+      // The first frame is a full repaint either way
+      if (c == nchurn)
+        render();
+      else
+        render_cells(cells, hot, 0);
+      uint64_t start = out_bytes;
+      for (int i = 0; i < frames; i++) {
+        if (c == nchurn) {
+          doomfire_step(fire);
+          render();
+          continue;
+        }
+        for (size_t k = 0; k < visible * churn[c] / 100; k++) {
+          uint64_t r = fire_rng_next64(&rng);
+          cells[(r >> 8) % visible] = (uint8_t)r;
+        }
+        render_cells(cells, hot, 0);
+      }
+      bytes[delta] = (double)(out_bytes - start) / frames;
+    }
+    char name[32];
+    if (c < nchurn)
+      snprintf(name, sizeof(name), "churn %d%%", churn[c]);
+    else
+      snprintf(name, sizeof(name), "fire");
+    printf("  %-10s full %9.0f  delta %9.0f  %8.2fx\n", name, bytes[0],
+           bytes[1], bytes[1] > 0 ? bytes[0] / bytes[1] : 0.0);
+  }
+  free(snapshot);
+  free(cells);
+  free(hot);
+  close(out_fd);
+  out_fd = user_fd;
+  delta_render = true;
+  shown_valid = false;
+}
+
+// Memory traffic model: an LRU cache of whole heat rows. Every miss reads a
+// row from DRAM and every evicted dirty row writes one back, which is what a
+// row-by-row sweep costs once the rows touched between two visits no longer
+// fit in cache.
+typedef struct {
+  const uint8_t *base[2]; // the two heat allocations
+  int capacity;           // rows that fit in the modelled cache
+  int count;
+  int *prev, *next; // LRU list over row ids, sentinel at index 0
+  uint8_t *state;   // bit 0: cached, bit 1: dirty
+  uint64_t bytes;   // DRAM traffic so far
+} TrafficModel;
+
+#define TRAFFIC_MODEL_BYTES (1024 * 1024)
+
+// DoomFireRowHook feeding the model
+static void traffic_touch(void *ctx, const uint8_t *row, bool write) {
+  TrafficModel *m = ctx;
+  ptrdiff_t stride = fire_cfg.stride;
+  int buf = row >= m->base[1] && row < m->base[1] + stride * height;
+  int id = 1 + buf * height + (int)((row - m->base[buf]) / stride);
+  if (m->state[id] & 1) {
+    m->next[m->prev[id]] = m->next[id];
+    m->prev[m->next[id]] = m->prev[id];
+  } else {
+    m->bytes += stride;
+    m->state[id] = 1;
+    if (++m->count > m->capacity) {
+      int lru = m->prev[0];
+      m->next[m->prev[lru]] = 0;
+      m->prev[0] = m->prev[lru];
+      if (m->state[lru] & 2)
+        m->bytes += stride;
+      m->state[lru] = 0;
+      m->count--;
+    }
+  }
+  m->state[id] |= write ? 2 : 0;
+  m->prev[id] = 0;
+  m->next[id] = m->next[0];
+  m->prev[m->next[0]] = id;
+  m->next[0] = id;
+}
+
+// Last-level cache misses of this thread, or -1 without hardware counters
+static int llc_counter_open(void) {
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+static uint64_t llc_counter_read(int fd) {
+  uint64_t v = 0;
+  if (fd >= 0 && read(fd, &v, sizeof(v)) != sizeof(v))
+    v = 0;
+  return v;
+}
+
+// DRAM bytes per stepped cell for the row sweep and for temporal blocking:
+// modelled with an LRU cache of rows, and measured from LLC misses when the
+// hardware counters are available
+static void bench_traffic(int frames) {
+  int user_threads = fire_cfg.threads;
+  fire_cfg.threads = 1; // the model is not thread-safe
+  create_fire();
+  int capacity = TRAFFIC_MODEL_BYTES / fire_cfg.stride;
+  printf("memory traffic, %s, model: %d KiB cache (%d rows), block depth %d\n",
+         doomfire_propagation_names[fire_cfg.propagation],
+         TRAFFIC_MODEL_BYTES / 1024, capacity, doomfire_block_depth(fire));
+
+  uint64_t ref = 0;
+  for (int blocked = 0; blocked < 2; blocked++) {
+    int ids = 2 * height + 1;
+    TrafficModel model = {.base = {fire_buffer, prev_buffer},
+                          .capacity = capacity > 0 ? capacity : 1,
+                          .prev = calloc(ids, sizeof(int)),
+                          .next = calloc(ids, sizeof(int)),
+                          .state = calloc(ids, 1)};
+    doomfire_reset(fire);
+    // Warm up until the flames reach full height
+    int warm = height < 300 ? height : 300;
+    if (blocked)
+      doomfire_step_n(fire, warm);
+    else
+      for (int i = 0; i < warm; i++)
+        doomfire_step(fire);
+
+    const DoomFireStats *st = doomfire_stats(fire);
+    uint64_t stepped = st->cells - st->cells_skipped;
+    int fd = llc_counter_open();
+    uint64_t misses = llc_counter_read(fd);
+    doomfire_set_row_hook(fire, traffic_touch, &model);
+    double t0 = now_sec();
+    if (blocked)
+      doomfire_step_n(fire, frames);
+    else
+      for (int i = 0; i < frames; i++)
+        doomfire_step(fire);
+    double dt = now_sec() - t0;
+    doomfire_set_row_hook(fire, NULL, NULL);
+    misses = llc_counter_read(fd) - misses;
+    if (fd >= 0)
+      close(fd);
+    stepped = st->cells - st->cells_skipped - stepped;
+
+    uint64_t sum =
+        hash_buffer(doomfire_heat(fire), (size_t)fire_cfg.stride * height);
+    if (!blocked)
+      ref = sum;
+    char llc[32] = "n/a";
+    if (fd >= 0)
+      snprintf(llc, sizeof(llc), "%.3f", 64.0 * misses / stepped);
+    printf("  %-8s %9.1f Mcells/s  model %6.3f B/cell  llc %s B/cell  %s\n",
+           blocked ? "blocked" : "sweep",
+           (double)width * height * frames / dt / 1e6,
+           (double)model.bytes / stepped, llc,
+           sum == ref ? "ok" : "MISMATCH");
+    free(model.prev);
+    free(model.next);
+    free(model.state);
+  }
+  fire_cfg.threads = user_threads;
+  create_fire();
+}
+
+#define BATCH_SIZE 128 // sprite texture edge
+#define BATCH_FRAMES 60
+
+// Many small fires: `count` separate 128x128 instances stepped one by one
+// versus one batched instance with SIMD lanes across them, both on one thread
+static void bench_batch(int count) {
+  size_t cells = (size_t)BATCH_SIZE * BATCH_SIZE;
+  int cell = fire_cfg.heat16 ? 2 : 1;
+  size_t bytes = cells * cell;
+  printf("batch, %d instances of %dx%d, %d frames\n", count, BATCH_SIZE,
+         BATCH_SIZE, BATCH_FRAMES);
+
+  DoomFireConfig cfg = fire_cfg;
+  cfg.width = cfg.height = BATCH_SIZE;
+  cfg.stride = BATCH_SIZE * cell;
+  cfg.threads = 1;
+  DoomFire **one = calloc(count, sizeof(*one));
+  uint8_t *heat = calloc(bytes * count, 2);
+  for (int i = 0; i < count; i++) {
+    cfg.heat = heat + bytes * 2 * i;
+    cfg.back = cfg.heat + bytes;
+    one[i] = doomfire_create(&cfg);
+    for (int t = 0; t < 30; t++) // warm up like time_update()
+      doomfire_step(one[i]);
+  }
+  double t0 = now_sec();
+  for (int t = 0; t < BATCH_FRAMES; t++)
+    for (int i = 0; i < count; i++)
+      doomfire_step(one[i]);
+  double single = count * BATCH_FRAMES / (now_sec() - t0);
+  for (int i = 0; i < count; i++)
+    doomfire_destroy(one[i]);
+  free(one);
+
+  cfg.instances = count;
+  cfg.stride = (ptrdiff_t)BATCH_SIZE * count * cell;
+  cfg.heat = heat;
+  cfg.back = heat + bytes * count;
+  DoomFire *batch = doomfire_create(&cfg);
+  for (int t = 0; t < 30; t++)
+    doomfire_step(batch);
+  t0 = now_sec();
+  for (int t = 0; t < BATCH_FRAMES; t++)
+    doomfire_step(batch);
+  double batched = count * BATCH_FRAMES / (now_sec() - t0);
+  doomfire_destroy(batch);
+  free(heat);
+
+  printf("  %-8s %9.0f instances/s  %9.1f Mcells/s  %5.2fx\n", "separate",
+         single, single * cells / 1e6, 1.0);
+  printf("  %-8s %9.0f instances/s  %9.1f Mcells/s  %5.2fx\n", "batched",
+         batched, batched * cells / 1e6, batched / single);
+}
+
+// Headless simulation throughput, no terminal involved. Thread scaling is
+// measured from 1 to max_threads.
+static void run_bench(int w, int h, int frames, int max_threads, int batch) {
+  resize_buffers(w, h);
+  double cells = (double)w * h * frames;
+  printf("doomfire_step %dx%d, %d frames, kernel %s, %s\n", w, h, frames,
+         doomfire_kernel_names[doomfire_config(fire)->kernel],
+         doomfire_propagation_names[fire_cfg.propagation]);
+
+  FireRngKind user_rng = fire_cfg.rng;
+  double base = 0;
+  for (int k = FIRE_RNG_COUNT - 1; k >= 0; k--) {
+    fire_cfg.rng = k;
+    create_fire();
+    double rate = cells / time_update(frames);
+    if (k == FIRE_RNG_LIBC)
+      base = rate;
+    printf("  rng %-8s %9.1f Mcells/s  %5.2fx\n", fire_rng_names[k],
+           rate / 1e6, rate / base);
+  }
+  fire_cfg.rng = user_rng;
+
+  // Every kernel must reproduce the scalar result bit for bit, in both heat
+  // formats. 16-bit kernels cover half the cells per vector but compute the
+  // decay with one multiply instead of a compare per level.
+  DoomFireKernel user_kernel = fire_cfg.kernel;
+  DoomFirePropagation user_propagation = fire_cfg.propagation;
+  bool user_heat16 = fire_cfg.heat16;
+  uint64_t ref = 0;
+  for (int bits = 8; bits <= 16; bits += 8) {
+    set_heat16(bits == 16);
+    for (int p = 0; p < DOOMFIRE_PROPAGATION_COUNT; p++) {
+      fire_cfg.propagation = p;
+      printf("kernels, %s, %d-bit heat, rng %s\n",
+             doomfire_propagation_names[p], bits, fire_rng_names[fire_cfg.rng]);
+      for (int k = 0; k < DOOMFIRE_KERNEL_COUNT; k++) {
+        if (!doomfire_kernel_supported(k))
+          continue;
+        fire_cfg.kernel = k;
+        create_fire();
+        double rate = cells / time_update(frames);
+        uint64_t sum =
+            hash_buffer(doomfire_heat(fire), (size_t)fire_cfg.stride * h);
+        if (k == DOOMFIRE_KERNEL_SCALAR) {
+          ref = sum;
+          base = rate;
+        }
+        printf("  %-8s %9.1f Mcells/s  %5.2fx  %s\n", doomfire_kernel_names[k],
+               rate / 1e6, rate / base, sum == ref ? "ok" : "MISMATCH");
+      }
+    }
+  }
+  fire_cfg.kernel = user_kernel;
+
+  // Pull must look like push: same heat, coverage and flame height. 16-bit
+  // heat at the same cooling must look like 8-bit heat too.
+  printf("flame shape       mean heat  lit cells  height  skipped\n");
+  for (int bits = 8; bits <= 16; bits += 8) {
+    set_heat16(bits == 16);
+    for (int p = 0; p < DOOMFIRE_PROPAGATION_COUNT; p++) {
+      double st[4];
+      char name[32];
+      fire_cfg.propagation = p;
+      create_fire();
+      flame_stats(frames, st);
+      snprintf(name, sizeof(name), "%s %d-bit", doomfire_propagation_names[p],
+               bits);
+      printf("  %-14s %10.2f %9.1f%% %7.1f %7.1f%%\n", name, st[0],
+             st[1] * 100, st[2], st[3] * 100);
+    }
+  }
+  set_heat16(user_heat16);
+  fire_cfg.propagation = user_propagation;
+
+  // Speedup curve; rows draw from their own RNG streams, so the result must
+  // not depend on the thread count either
+  create_fire();
+  printf("threads, kernel %s, %s\n",
+         doomfire_kernel_names[doomfire_config(fire)->kernel],
+         doomfire_propagation_names[fire_cfg.propagation]);
+  int user_threads = fire_cfg.threads;
+  for (int t = 1; t <= max_threads; t++) {
+    fire_cfg.threads = t;
+    create_fire();
+    double rate = cells / time_update(frames);
+    uint64_t sum =
+        hash_buffer(doomfire_heat(fire), (size_t)fire_cfg.stride * h);
+    if (t == 1) {
+      ref = sum;
+      base = rate;
+    }
+    printf("  %3d %9.1f Mcells/s  %5.2fx  %s\n",
+           doomfire_config(fire)->threads, rate / 1e6, rate / base,
+           sum == ref ? "ok" : "MISMATCH");
+  }
+  fire_cfg.threads = user_threads;
+  create_fire();
+
+  bench_render(frames, max_threads);
+  bench_sixel(frames);
+  bench_kitty(frames);
+  bench_screen(frames);
+  bench_delta(frames);
+  bench_traffic(frames);
+  bench_batch(batch);
+}
+
+// --- Golden Frames ---
+//
+// Regression net for kernel and threading work: fixed cases are run headless
+// from a fixed seed and the heat buffer of every frame is hashed. --golden
+// compares those hashes against a checked-in file for every kernel the CPU
+// supports, with 1 and 3 threads and with temporal blocking; --golden-write
+// regenerates the file after an intended change of output.
+
+#define GOLDEN_W 96
+#define GOLDEN_H 48
+#define GOLDEN_FRAMES 64
+#define GOLDEN_SEED 1
+
+typedef struct {
+  const char *name;
+  DoomFirePropagation propagation;
+  DoomFireEdge edge;
+  bool heat16;
+  int cooling_max; // in 1/256 levels for 16-bit heat
+  int instances;
+  FireRngKind rng; // libc is left out: rand() is global, not per stream
+} GoldenCase;
+
+static const GoldenCase golden_cases[] = {
+    {"push", DOOMFIRE_PUSH, DOOMFIRE_EDGE_CLIP, false, COOLING_MAX, 1,
+     FIRE_RNG_HASH},
+    {"pull", DOOMFIRE_PULL, DOOMFIRE_EDGE_CLIP, false, COOLING_MAX, 1,
+     FIRE_RNG_HASH},
+    {"clamp", DOOMFIRE_PUSH, DOOMFIRE_EDGE_CLAMP, false, 2, 1,
+     FIRE_RNG_XOSHIRO},
+    {"batch", DOOMFIRE_PULL, DOOMFIRE_EDGE_CLAMP, false, COOLING_MAX, 5,
+     FIRE_RNG_HASH},
+    {"heat16", DOOMFIRE_PUSH, DOOMFIRE_EDGE_CLIP, true, 192, 1, FIRE_RNG_HASH},
+    {"pull16", DOOMFIRE_PULL, DOOMFIRE_EDGE_CLAMP, true, 700, 3,
+     FIRE_RNG_XOSHIRO},
+};
+
+#define GOLDEN_CASES (int)(sizeof(golden_cases) / sizeof(golden_cases[0]))
+
+// Run case `c` and store the hash after each frame in out[GOLDEN_FRAMES].
+// With `blocked` only the last frame is produced, by doomfire_step_n().
+static void golden_run(const GoldenCase *c, DoomFireKernel kernel,
+                       int threads, bool blocked, uint64_t *out) {
+  DoomFireConfig cfg;
+  doomfire_config_default(&cfg, GOLDEN_W, GOLDEN_H);
+  cfg.instances = c->instances;
+  cfg.heat16 = c->heat16;
+  cfg.stride = (ptrdiff_t)GOLDEN_W * c->instances * (c->heat16 ? 2 : 1);
+  size_t bytes = (size_t)cfg.stride * GOLDEN_H;
+  cfg.heat = calloc(bytes, 1);
+  cfg.back = calloc(bytes, 1);
+  cfg.propagation = c->propagation;
+  cfg.edge = c->edge;
+  cfg.cooling_max = c->cooling_max;
+  cfg.spark_chance = SPARK_CHANCE;
+  cfg.rng = c->rng;
+  cfg.seed = GOLDEN_SEED;
+  cfg.threads = threads;
+  cfg.kernel = kernel;
+  DoomFire *f = doomfire_create(&cfg);
+
+  if (blocked) {
+    doomfire_step_n(f, GOLDEN_FRAMES);
+    out[GOLDEN_FRAMES - 1] = hash_buffer(doomfire_heat(f), bytes);
+  } else {
+    for (int i = 0; i < GOLDEN_FRAMES; i++) {
+      doomfire_step(f);
+      out[i] = hash_buffer(doomfire_heat(f), bytes);
+    }
+  }
+  doomfire_destroy(f);
+  free(cfg.heat);
+  free(cfg.back);
+}
+
+// Write the reference hashes (scalar kernel, one thread) to `path`
+static int golden_write(const char *path) {
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    perror(path);
+    return 1;
+  }
+  fprintf(fp, "# fire --golden: heat buffer FNV-1a per frame, %dx%d, seed %d\n"
+              "# case frame hash\n",
+          GOLDEN_W, GOLDEN_H, GOLDEN_SEED);
+  for (int c = 0; c < GOLDEN_CASES; c++) {
+    uint64_t h[GOLDEN_FRAMES];
+    golden_run(&golden_cases[c], DOOMFIRE_KERNEL_SCALAR, 1, false, h);
+    for (int i = 0; i < GOLDEN_FRAMES; i++)
+      fprintf(fp, "%s %d %016llx\n", golden_cases[c].name, i,
+              (unsigned long long)h[i]);
+  }
+  fclose(fp);
+  return 0;
+}
+
+// The renderer through the screen model, in every glyph mode: deltas,
+// repaints, and 256 colors on 3 encoding threads. Each run resizes the
+// terminal and drops heat bits halfway. Returns the runs that failed.
+static int golden_screen(void) {
+  int user_fd = out_fd;
+  out_fd = open("/dev/null", O_WRONLY);
+  init_palette();
+  fire_cfg.seed = GOLDEN_SEED;
+  VtScreen model = {0};
+  int failed = 0;
+  for (int g = 0; g < GLYPH_COUNT; g++)
+    for (int run = 0; run < 3; run++) {
+      truecolor = run != 2;
+      delta_render = run != 1;
+      fire_cfg.threads = run == 2 ? 3 : 1;
+      set_glyph_mode(g);
+      color_shift = 0;
+      resize_buffers(GOLDEN_W / 2, GOLDEN_H / 2);
+      vt_resize(&model, term_cols, term_rows);
+      int bad = vt_render(&model, GOLDEN_FRAMES / 2);
+      resize_buffers(GOLDEN_W / 2 + 7, GOLDEN_H / 2 - 5);
+      screen_clear = true;
+      vt_resize(&model, term_cols, term_rows);
+      color_shift = 2;
+      bad += vt_render(&model, GOLDEN_FRAMES / 2);
+      const char *how = run == 0   ? "delta"
+                        : run == 1 ? "repaint"
+                                   : "256 colors, 3 threads";
+      printf("screen %-8s %-21s ", glyph_names[g], how);
+      if (!bad && !model.unknown) {
+        printf("ok\n");
+      } else {
+        printf("MISMATCH in %d frames, %llu unknown escapes\n", bad,
+               (unsigned long long)model.unknown);
+        failed++;
+      }
+    }
+  free(model.cells);
+  close(out_fd);
+  out_fd = user_fd;
+  color_shift = 0;
+  return failed;
+}
+
+// Check every kernel and thread count against `path`, returns the exit code
+static int golden_check(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    perror(path);
+    return 1;
+  }
+  static uint64_t want[GOLDEN_CASES][GOLDEN_FRAMES];
+  static bool have[GOLDEN_CASES][GOLDEN_FRAMES];
+  char line[128], name[32];
+  int frame;
+  unsigned long long hash;
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#' ||
+        sscanf(line, "%31s %d %llx", name, &frame, &hash) != 3 || frame < 0 ||
+        frame >= GOLDEN_FRAMES)
+      continue;
+    for (int c = 0; c < GOLDEN_CASES; c++)
+      if (strcmp(name, golden_cases[c].name) == 0) {
+        want[c][frame] = hash;
+        have[c][frame] = true;
+      }
+  }
+  fclose(fp);
+
+  int failed = 0;
+  for (int c = 0; c < GOLDEN_CASES; c++) {
+    const GoldenCase *gc = &golden_cases[c];
+    for (int i = 0; i < GOLDEN_FRAMES; i++)
+      if (!have[c][i]) {
+        printf("%-6s missing from %s\n", gc->name, path);
+        failed++;
+        break;
+      }
+    if (!have[c][GOLDEN_FRAMES - 1])
+      continue;
+    for (int k = 0; k < DOOMFIRE_KERNEL_COUNT; k++) {
+      if (!doomfire_kernel_supported(k))
+        continue;
+      for (int run = 0; run < 3; run++) {
+        int threads = run == 1 ? 3 : 1;
+        bool blocked = run == 2;
+        uint64_t h[GOLDEN_FRAMES];
+        golden_run(gc, k, threads, blocked, h);
+        int bad = -1;
+        for (int i = blocked ? GOLDEN_FRAMES - 1 : 0; i < GOLDEN_FRAMES; i++)
+          if (!have[c][i] || h[i] != want[c][i]) {
+            bad = i;
+            break;
+          }
+        char how[32];
+        snprintf(how, sizeof(how), "%d thread%s%s", threads,
+                 threads > 1 ? "s" : "", blocked ? ", blocked" : "");
+        printf("%-6s %-7s %-18s ", gc->name, doomfire_kernel_names[k], how);
+        if (bad < 0) {
+          printf("ok\n");
+        } else {
+          printf("MISMATCH at frame %d\n", bad);
+          failed++;
+        }
+      }
+    }
+  }
+  failed += golden_screen();
+  printf("%s\n", failed ? "golden: FAILED" : "golden: all ok");
+  return failed ? 1 : 0;
+}
+
+// --- Output Pacing ---
+//
+// The terminal reads output at its own pace. What it has not read yet waits
+// in the tty output queue (TIOCOUTQ) and, with the writer thread, in the
+// frame being written; all of it is delay before the latest frame can
+// show. The pacer estimates how fast the terminal drains and
+// spaces frames so that they drain in time, and keeps the backlog under
+// what drains in `latency` seconds: while over, it stretches the period
+// further and coarsens the colors (fewer distinct colors give longer SGR
+// runs and fewer changed cells), and once well under for a while it undoes
+// both, period first.
+
+#define PACE_PERIOD_MAX 0.5 // seconds, the slowest it goes
+#define PACE_CALM 0.25      // seconds well under target before easing off
+#define PACE_WINDOW 0.5     // seconds per drain measurement, past bursts
+#define DETAIL_MAX 4        // heat bits dropped at most
+
+typedef struct {
+  double latency;     // target, seconds; 0 turns the pacer off
+  double period;      // seconds between frames
+  double drain;       // bytes/s the terminal reads, 0 until measured
+  double frame_bytes; // average frame size
+  double stretch;     // period over drain time; under 1 probes for more
+  double t;           // window start: time, bytes sent, queue depth, busy
+  uint64_t sent;
+  int outq;
+  double busy;
+  double calm_since;  // when the backlog last was not well under target
+  double max_backlog; // bytes, for --stats
+} Pacer;
+
+static Pacer pacer = {
+    .latency = 0.05, .period = 1.0 / TARGET_FPS, .stretch = 1};
+
+// Bytes in the tty output queue, 0 where it cannot be asked
+static int tty_outq(int fd) {
+  int n = 0;
+#ifdef TIOCOUTQ
+  if (ioctl(fd, TIOCOUTQ, &n) < 0)
+    n = 0;
+#else
+  (void)fd;
+#endif
+  return n;
+}
+
+// Sample the backlog after a frame of `bytes`, 0 when none was sent, and
+// adjust the period and color detail
+static void pace(Pacer *p, size_t bytes) {
+  double t = now_sec();
+  int outq = tty_outq(out_fd);
+  pthread_mutex_lock(&mb_lock);
+  uint64_t sent = sent_bytes;
+  double busy = write_busy;
+  // Ahead of the frame just posted (out_frame) in the mailbox
+  size_t ahead =
+      mb_writing && mb_writing != out_frame ? mb_writing->bytes : 0;
+  pthread_mutex_unlock(&mb_lock);
+
+  // Drained over the window: what went into the queue minus its growth,
+  // over the time the writer was blocked on it when that was most of the
+  // time. Otherwise the terminal kept up and this is a lower bound.
+  double dt = t - p->t, dbusy = busy - p->busy;
+  if (dt >= PACE_WINDOW) {
+    double drained = (double)(sent - p->sent) - (outq - p->outq);
+    if (p->t > 0 && dbusy > dt / 2) {
+      double rate = drained / dbusy;
+      p->drain = p->drain > 0 ? 0.5 * p->drain + 0.5 * rate : rate;
+    } else if (p->t > 0 && drained / dt > p->drain) {
+      p->drain = drained / dt;
+    }
+    p->t = t;
+    p->sent = sent;
+    p->outq = outq;
+    p->busy = busy;
+  }
+  // Only frames that went out: a skipped one says nothing about their size
+  if (bytes > 0)
+    p->frame_bytes =
+        p->frame_bytes > 0 ? 0.9 * p->frame_bytes + 0.1 * bytes : (double)bytes;
+
+  double backlog = (double)outq + ahead;
+  if (backlog > p->max_backlog)
+    p->max_backlog = backlog;
+  if (p->latency <= 0 || p->drain <= 0)
+    return;
+  double target = p->drain * p->latency;
+  if (backlog > target) {
+    if (p->stretch < 4)
+      p->stretch *= 1.25;
+    if (color_shift < DETAIL_MAX)
+      color_shift++;
+    p->calm_since = t;
+  } else if (backlog > target / 4) {
+    p->calm_since = t;
+  } else if (t - p->calm_since >= PACE_CALM) {
+    if (p->stretch > 1)
+      p->stretch = p->stretch * 0.8 > 1 ? p->stretch * 0.8 : 1;
+    else if (color_shift > 0)
+      color_shift--;
+    else if (p->stretch > 0.5)
+      p->stretch *= 0.8; // maybe the terminal is faster than measured
+    p->calm_since = t;
+  }
+
+  // Frames no faster than the terminal drains them, with some headroom
+  double period = 1.1 * p->frame_bytes / p->drain * p->stretch;
+  double base = 1.0 / target_fps;
+  p->period = period < base              ? base
+              : period > PACE_PERIOD_MAX ? PACE_PERIOD_MAX
+                                         : period;
+}
+
+// --- PTY Benchmark ---
+//
+// /dev/null takes any write at once, so --bench cannot show what sending
+// frames to a tty costs: line discipline buffers, short writes, the writer
+// thread blocking and dropping frames. --bench-pty runs each mode in a child
+// on a pseudo-terminal of --size cells for --frames frames, unpaced, while
+// this process drains the master side as fast as it can, like a terminal
+// that parses nothing. The child sends its counters back through a pipe.
+
+typedef struct {
+  const char *name;
+  Backend backend;
+  GlyphMode glyph;
+  bool delta, writer;
+} PtyCase;
+
+typedef struct {
+  uint64_t rendered, written, dropped, bytes, writes;
+  double secs;
+  double p50, p99, max; // step and render time per frame
+} PtyResult;
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// In the child, with the pty as stdin and stdout
+static void pty_child(const PtyCase *c, int frames, int result_fd) {
+  init_terminal();
+  truecolor = true;
+  backend = c->backend;
+  delta_render = c->delta;
+  set_glyph_mode(c->glyph);
+  if (c->writer)
+    start_writer();
+  struct winsize w;
+  ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+  set_cell_pixels(&w);
+  resize_buffers(w.ws_col, w.ws_row);
+
+  double *times = malloc(frames * sizeof(*times));
+  double start = now_sec();
+  int n = 0;
+  while (n < frames && running) {
+    double t0 = now_sec();
+    doomfire_step(fire);
+    render();
+    times[n++] = now_sec() - t0;
+  }
+  stop_writer();
+  PtyResult r = {.rendered = out_frames,
+                 .written = frames_written,
+                 .dropped = frames_dropped,
+                 .bytes = out_bytes,
+                 .writes = out_writes,
+                 .secs = now_sec() - start};
+  qsort(times, n, sizeof(*times), compare_double);
+  r.p50 = times[n / 2];
+  r.p99 = times[n * 99 / 100];
+  r.max = times[n - 1];
+  if (write(result_fd, &r, sizeof(r)) != sizeof(r))
+    _exit(1);
+  _exit(0); // the terminal is left as it is, nobody sees it
+}
+
+// Run one case on a new pty, return false if it could not run
+static bool pty_run(const PtyCase *c, int cols, int rows, int frames,
+                    PtyResult *r, uint64_t *drained) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) || unlockpt(master)) {
+    perror("posix_openpt");
+    return false;
+  }
+  // This end of the slave stays open so the master never reads as hung up
+  int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  struct winsize w = {.ws_row = rows,
+                      .ws_col = cols,
+                      .ws_xpixel = cols * SIXEL_CELL_W,
+                      .ws_ypixel = rows * SIXEL_CELL_H};
+  int result[2];
+  if (slave < 0 || ioctl(master, TIOCSWINSZ, &w) || pipe(result)) {
+    perror("pty");
+    close(master);
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(master);
+    close(result[0]);
+    setsid();
+    ioctl(slave, TIOCSCTTY, 0);
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    close(slave);
+    pty_child(c, frames, result[1]);
+  }
+  close(result[1]);
+
+  char buf[65536];
+  ssize_t n;
+  bool ok = false;
+  *drained = 0;
+  struct pollfd p[2] = {{.fd = master, .events = POLLIN},
+                        {.fd = result[0], .events = POLLIN}};
+  while (pid > 0) {
+    if (poll(p, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (p[0].revents & POLLIN && (n = read(master, buf, sizeof(buf))) > 0)
+      *drained += n;
+    if (p[1].revents) {
+      ok = read(result[0], r, sizeof(*r)) == sizeof(*r);
+      break;
+    }
+  }
+  if (pid > 0)
+    waitpid(pid, NULL, 0);
+  // What the child wrote last may still be in the pty
+  p[0].revents = 0;
+  while (poll(p, 1, 0) > 0 && (n = read(master, buf, sizeof(buf))) > 0)
+    *drained += n;
+  close(result[0]);
+  close(slave);
+  close(master);
+  return ok;
+}
+
+static void bench_pty(int cols, int rows, int frames) {
+  static const PtyCase cases[] = {
+      {"text full, delta", BACKEND_TEXT, GLYPH_FULL, true, true},
+      {"text full, inline write", BACKEND_TEXT, GLYPH_FULL, true, false},
+      {"text full, repaint", BACKEND_TEXT, GLYPH_FULL, false, true},
+      {"text half, delta", BACKEND_TEXT, GLYPH_HALF, true, true},
+      {"text braille, delta", BACKEND_TEXT, GLYPH_BRAILLE, true, true},
+      {"sixel", BACKEND_SIXEL, GLYPH_FULL, false, true},
+      {"kitty, inline", BACKEND_KITTY, GLYPH_FULL, false, true}};
+  printf("pty %dx%d cells, %d frames, unpaced; frame times are step and "
+         "render\n",
+         cols, rows, frames);
+  printf("  %-24s %7s %7s %9s %7s %7s %7s %7s\n", "", "render", "sent",
+         "bytes", "writes", "p50", "p99", "max");
+  printf("  %-24s %7s %7s %9s %7s %7s %7s %7s\n", "", "fps", "fps",
+         "/frame", "/frame", "ms", "ms", "ms");
+  for (int k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++) {
+    PtyResult r;
+    uint64_t drained;
+    if (!pty_run(&cases[k], cols, rows, frames, &r, &drained) ||
+        !r.written) {
+      printf("  %-24s failed\n", cases[k].name);
+      continue;
+    }
+    printf("  %-24s %7.1f %7.1f %9.0f %7.2f %7.2f %7.2f %7.2f%s\n",
+           cases[k].name, r.rendered / r.secs, r.written / r.secs,
+           (double)r.bytes / r.written, (double)r.writes / r.written,
+           r.p50 * 1e3, r.p99 * 1e3, r.max * 1e3,
+           drained < r.bytes ? "  (short read)" : "");
+  }
+}
+
+// --- Frame Loop ---
+//
+// Frames start on a grid of absolute deadlines, each one period after the
+// last, so the time spent simulating, rendering and being woken does not
+// add up to drift. Between frames the loop sleeps until the deadline and
+// takes input and signals as they come: on Linux in epoll_wait(), with the
+// deadline in a timerfd (TFD_TIMER_ABSTIME) and signals from a signalfd;
+// elsewhere, or if those fail, in poll() on stdin with signal handlers.
+// A frame that starts whole periods late has missed those ticks. --late skip
+// drops them and keeps to the grid; --late catch-up also runs their
+// simulation steps, up to CATCH_UP_MAX per frame, so the fire keeps its
+// speed.
+
+#define CATCH_UP_MAX 4 // simulation steps per frame at most
+
+typedef enum { LATE_SKIP = 0, LATE_CATCH_UP, LATE_COUNT } LatePolicy;
+static const char *const late_names[LATE_COUNT] = {"skip", "catch-up"};
+
+typedef struct {
+  LatePolicy late;
+  double deadline; // of the next frame, in now_sec() time
+  double last;     // start of the last frame, and when it was due
+  double last_due;
+  int epoll, timer, signals; // -1 when polling
+  // For --stats: frames, ticks missed, and sums and maxima of the period
+  // between frame starts, of its jitter (how far it is off the period
+  // between their deadlines) and of how late frames start
+  uint64_t frames, missed;
+  double period_sum, jitter_sum, jitter_max, late_sum, late_max;
+} FrameClock;
+
+static FrameClock frame_clock = {.epoll = -1, .timer = -1, .signals = -1};
+
+// Take the timer and signals as fds where the system has them. Called
+// before any thread starts, so every thread blocks the signals.
+static void frame_clock_init(FrameClock *c) {
+#ifdef __linux__
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGTERM);
+  sigaddset(&set, SIGWINCH);
+  c->epoll = epoll_create1(EPOLL_CLOEXEC);
+  c->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  c->signals = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+  int fds[3] = {STDIN_FILENO, c->timer, c->signals};
+  bool ok = c->epoll >= 0 && c->timer >= 0 && c->signals >= 0;
+  for (int i = 0; ok && i < 3; i++) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fds[i]};
+    ok = epoll_ctl(c->epoll, EPOLL_CTL_ADD, fds[i], &ev) == 0;
+  }
+  if (ok) {
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+  } else {
+    int *own[3] = {&c->epoll, &c->timer, &c->signals};
+    for (int i = 0; i < 3; i++) {
+      if (*own[i] >= 0)
+        close(*own[i]);
+      *own[i] = -1;
+    }
+  }
+#endif
+}
+
+// Input between frames: kitty's replies are counted and keystrokes dropped
+// (Ctrl-C comes as a signal). A hangup ends the program.
+static void read_input(void) {
+  struct pollfd p = {.fd = STDIN_FILENO, .events = POLLIN};
+  if (poll(&p, 1, 0) > 0 && p.revents & (POLLHUP | POLLERR))
+    running = false;
+  kitty_read_replies();
+}
+
+// Sleep until the deadline, handling input and signals meanwhile
+static void frame_wait(FrameClock *c) {
+#ifdef __linux__
+  if (c->epoll >= 0) {
+    struct itimerspec at = {0};
+    at.it_value.tv_sec = (time_t)c->deadline;
+    at.it_value.tv_nsec = (long)((c->deadline - at.it_value.tv_sec) * 1e9);
+    at.it_value.tv_nsec += !at.it_value.tv_sec && !at.it_value.tv_nsec;
+    timerfd_settime(c->timer, TFD_TIMER_ABSTIME, &at, NULL);
+    bool due = false;
+    while (running && !due) {
+      struct epoll_event ev[3];
+      int n = epoll_wait(c->epoll, ev, 3, -1);
+      for (int i = 0; i < n; i++) {
+        int fd = ev[i].data.fd;
+        if (fd == c->timer) {
+          uint64_t ticks; // expirations since armed
+          due |= read(fd, &ticks, sizeof(ticks)) == sizeof(ticks);
+        } else if (fd == c->signals) {
+          struct signalfd_siginfo si;
+          while (read(fd, &si, sizeof(si)) == sizeof(si))
+            handle_signal((int)si.ssi_signo);
+        } else {
+          read_input();
+        }
+      }
+    }
+    return;
+  }
+#endif
+  while (running) {
+    double left = c->deadline - now_sec();
+    if (left <= 0)
+      return;
+    if (left < 1e-3) {
+      // Under poll()'s resolution: sleep out the rest
+      struct timespec ts = {0, (long)(left * 1e9)};
+      nanosleep(&ts, NULL);
+      return;
+    }
+    struct pollfd p = {.fd = STDIN_FILENO, .events = POLLIN};
+    if (poll(&p, 1, (int)(left * 1000)) > 0)
+      read_input();
+  }
+}
+
+// Start a frame due at the deadline, `period` after the last one: time it,
+// count ticks missed and return the simulation steps to run
+static int frame_start(FrameClock *c, double period) {
+  double t = now_sec(), late = t - c->deadline;
+  if (c->frames) {
+    double jitter = fabs((t - c->last) - (c->deadline - c->last_due));
+    c->period_sum += t - c->last;
+    c->jitter_sum += jitter;
+    c->jitter_max = jitter > c->jitter_max ? jitter : c->jitter_max;
+  }
+  c->frames++;
+  c->last = t;
+  c->last_due = c->deadline;
+  late = late > 0 ? late : 0;
+  c->late_sum += late;
+  c->late_max = late > c->late_max ? late : c->late_max;
+  if (late < period)
+    return 1;
+  int behind = (int)(late / period);
+  c->missed += behind;
+  c->deadline += behind * period; // back on the grid
+  if (c->late == LATE_SKIP)
+    return 1;
+  return behind < CATCH_UP_MAX ? 1 + behind : CATCH_UP_MAX;
+}
+
+// --- Main ---
+
+static double start_time;
+
+static void print_stats(void) {
+  destroy_fire(); // fold the running simulation into the totals
+  if (!stats.frames)
+    return;
+  fprintf(stderr, "frames %llu, cold cells skipped %.0f/frame (%.1f%%)\n",
+          (unsigned long long)stats.frames,
+          (double)stats.cells_skipped / stats.frames,
+          100.0 * stats.cells_skipped / stats.cells);
+  if (frames_written)
+    fprintf(stderr,
+            "frames %llu rendered, %llu written, %llu dropped\n"
+            "output %.0f bytes/frame, %.2f writes/frame, %.1f KiB/s\n",
+            (unsigned long long)out_frames, (unsigned long long)frames_written,
+            (unsigned long long)frames_dropped,
+            (double)out_bytes / frames_written,
+            (double)out_writes / frames_written,
+            out_bytes / 1024.0 / (now_sec() - start_time));
+  const FrameClock *c = &frame_clock;
+  if (c->frames > 1)
+    fprintf(stderr,
+            "frame clock: period %.3f ms (target %.3f), jitter %.3f ms mean, "
+            "%.3f max, late %.3f ms mean, %.3f max, %llu ticks missed (%s)\n",
+            c->period_sum / (c->frames - 1) * 1e3, 1e3 / target_fps,
+            c->jitter_sum / (c->frames - 1) * 1e3, c->jitter_max * 1e3,
+            c->late_sum / c->frames * 1e3, c->late_max * 1e3,
+            (unsigned long long)c->missed, late_names[c->late]);
+  if (pacer.latency > 0 && frames_written)
+    fprintf(stderr,
+            "pacing: drain %.1f KiB/s, backlog up to %.1f KiB, "
+            "last %.1f fps, %d heat bits dropped\n",
+            pacer.drain / 1024, pacer.max_backlog / 1024, 1 / pacer.period,
+            color_shift);
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --rng NAME     random source: hash, xoshiro, libc\n"
+          "  --kernel NAME  propagation kernel: scalar, sse2, avx2, avx512,\n"
+          "                 neon (default: best the CPU supports)\n"
+          "  --threads N    simulation and encoding threads (default 1)\n"
+          "  --propagate M  push (classic scatter) or pull (gather from the\n"
+          "                 previous frame)\n"
+          "  --heat BITS    8 or 16 bits of heat per cell (default 8)\n"
+          "  --cooling N    heat levels lost per row, at most (default 3);\n"
+          "                 fractions need --heat 16\n"
+          "  --glyph MODE   heat cells per character: full (1), half (2),\n"
+          "                 quadrant (4), sextant (6) or braille (8)\n"
+          "  --backend NAME text (default), or one bitmap per frame: sixel\n"
+          "                 (heat values as color registers) or kitty\n"
+          "                 (pixels in shared memory, inline if remote)\n"
+          "  --scale N      pixels per heat cell in bitmaps: 1, 2 (default),\n"
+          "                 3 or 6\n"
+          "  --seed N       seed every random source with N (default: time)\n"
+          "  --writer MODE  thread (default: a writer thread sends frames and\n"
+          "                 drops them when the terminal falls behind) or\n"
+          "                 inline (the main loop waits for every write)\n"
+          "  --fps N        frames per second to aim for (default 60)\n"
+          "  --late MODE    missed frames: skip (default), or catch-up to\n"
+          "                 run their simulation steps too\n"
+          "  --latency MS   output backlog to aim for: fewer frames, colors\n"
+          "                 while the terminal lags (default 50, 0: off)\n"
+          "  --sync MODE    frames as synchronized updates (mode 2026): auto\n"
+          "                 (if the terminal reports it), on or off\n"
+          "  --stats        print frame and output statistics on exit\n"
+          "  --bench        run headless benchmarks and exit\n"
+          "  --bench-pty    time each render mode on a pseudo-terminal and\n"
+          "                 exit\n"
+          "  --size WxH     benchmark grid size, pty size in cells (default\n"
+          "                 400x120)\n"
+          "  --frames N     benchmark frames (default 500)\n"
+          "  --batch N      fires in the batched benchmark (default 256)\n"
+          "  --golden FILE  check headless frame hashes against FILE and exit\n"
+          "  --golden-write FILE\n"
+          "                 regenerate the golden hashes in FILE and exit\n",
+          argv0);
+  exit(2);
+}
+
+static int parse_name(const char *arg, const char *const *names, int count) {
+  for (int i = 0; i < count; i++)
+    if (strcmp(arg, names[i]) == 0)
+      return i;
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  bool bench = false, bench_tty = false;
+  bool show_stats = false;
+  bool seeded = false;
+  const char *golden = NULL;
+  bool golden_update = false;
+  int threads = 0;
+  int heat_bits = 8;
+  GlyphMode glyph_arg = GLYPH_FULL;
+  SyncMode sync_mode = SYNC_AUTO;
+  bool writer_thread = true;
+  int bench_w = 400, bench_h = 120, bench_frames = 500, bench_batch_n = 256;
+
+  doomfire_config_default(&fire_cfg, 0, 0);
+  fire_cfg.spark_chance = SPARK_CHANCE;
+  fire_cfg.edge = DOOMFIRE_EDGE_CLIP;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--bench") == 0) {
+      bench = true;
+    } else if (strcmp(arg, "--bench-pty") == 0) {
+      bench_tty = true;
+    } else if (strcmp(arg, "--stats") == 0) {
+      show_stats = true;
+    } else if (strcmp(arg, "--seed") == 0 && val) {
+      char *end;
+      fire_cfg.seed = strtoull(val, &end, 0);
+      if (*end)
+        usage(argv[0]);
+      seeded = true;
+      i++;
+    } else if ((strcmp(arg, "--golden") == 0 ||
+                strcmp(arg, "--golden-write") == 0) &&
+               val) {
+      golden = val;
+      golden_update = strcmp(arg, "--golden-write") == 0;
+      i++;
+    } else if (strcmp(arg, "--heat") == 0 && val) {
+      heat_bits = atoi(val);
+      if (heat_bits != 8 && heat_bits != 16)
+        usage(argv[0]);
+      i++;
+    } else if (strcmp(arg, "--cooling") == 0 && val) {
+      char *end;
+      cooling = strtod(val, &end);
+      if (*end || !(cooling >= 0 && cooling <= 255))
+        usage(argv[0]);
+      i++;
+    } else if (strcmp(arg, "--glyph") == 0 && val) {
+      int m = parse_name(val, glyph_names, GLYPH_COUNT);
+      if (m < 0)
+        usage(argv[0]);
+      glyph_arg = m;
+      i++;
+    } else if (strcmp(arg, "--backend") == 0 && val) {
+      int b = parse_name(val, backend_names, BACKEND_COUNT);
+      if (b < 0)
+        usage(argv[0]);
+      backend = b;
+      i++;
+    } else if (strcmp(arg, "--scale") == 0 && val) {
+      pixel_scale = atoi(val);
+      if (pixel_scale <= 0 || 6 % pixel_scale)
+        usage(argv[0]);
+      i++;
+    } else if (strcmp(arg, "--writer") == 0 && val) {
+      if (strcmp(val, "thread") && strcmp(val, "inline"))
+        usage(argv[0]);
+      writer_thread = strcmp(val, "thread") == 0;
+      i++;
+    } else if (strcmp(arg, "--fps") == 0 && val) {
+      target_fps = atoi(val);
+      if (target_fps <= 0 || target_fps > 1000)
+        usage(argv[0]);
+      i++;
+    } else if (strcmp(arg, "--late") == 0 && val) {
+      int m = parse_name(val, late_names, LATE_COUNT);
+      if (m < 0)
+        usage(argv[0]);
+      frame_clock.late = m;
+      i++;
+    } else if (strcmp(arg, "--latency") == 0 && val) {
+      char *end;
+      pacer.latency = strtod(val, &end) / 1000;
+      if (*end || !(pacer.latency >= 0))
+        usage(argv[0]);
+      i++;
+    } else if (strcmp(arg, "--sync") == 0 && val) {
+      int m = parse_name(val, sync_names, SYNC_COUNT);
+      if (m < 0)
+        usage(argv[0]);
+      sync_mode = m;
+      i++;
+    } else if (strcmp(arg, "--rng") == 0 && val) {
+      int k = parse_name(val, fire_rng_names, FIRE_RNG_COUNT);
+      if (k < 0)
+        usage(argv[0]);
+      fire_cfg.rng = k;
+      i++;
+    } else if (strcmp(arg, "--kernel") == 0 && val) {
+      int k = parse_name(val, doomfire_kernel_names, DOOMFIRE_KERNEL_COUNT);
+      if (k < 0)
+        usage(argv[0]);
+      if (!doomfire_kernel_supported(k)) {
+        fprintf(stderr, "kernel %s is not supported on this CPU\n", val);
+        return 1;
+      }
+      fire_cfg.kernel = k;
+      i++;
+    } else if (strcmp(arg, "--propagate") == 0 && val) {
+      int p = parse_name(val, doomfire_propagation_names,
+                         DOOMFIRE_PROPAGATION_COUNT);
+      if (p < 0)
+        usage(argv[0]);
+      fire_cfg.propagation = p;
+      i++;
+    } else if (strcmp(arg, "--threads") == 0 && val) {
+      threads = atoi(val);
+      if (threads <= 0)
+        usage(argv[0]);
+      i++;
+    } else if (strcmp(arg, "--size") == 0 && val) {
+      if (sscanf(val, "%dx%d", &bench_w, &bench_h) != 2 || bench_w < 3 ||
+          bench_h < 2)
+        usage(argv[0]);
+      i++;
+    } else if (strcmp(arg, "--frames") == 0 && val) {
+      bench_frames = atoi(val);
+      if (bench_frames <= 0)
+        usage(argv[0]);
+      i++;
+    } else if (strcmp(arg, "--batch") == 0 && val) {
+      bench_batch_n = atoi(val);
+      if (bench_batch_n <= 0)
+        usage(argv[0]);
+      i++;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (golden)
+    return golden_update ? golden_write(golden) : golden_check(golden);
+
+  if (heat_bits == 8 && cooling != (int)cooling) {
+    fprintf(stderr, "fractional cooling needs --heat 16\n");
+    return 2;
+  }
+  set_heat16(heat_bits == 16);
+
+  // Every random byte comes from fire_cfg.seed, so a fixed seed replays the
+  // same frames whatever the kernel or thread count. --rng libc is the
+  // exception: rand() shares one global state between the threads.
+  if (!seeded)
+    fire_cfg.seed = (uint64_t)time(NULL);
+  srand((unsigned)fire_cfg.seed);
+  if (threads)
+    fire_cfg.threads = threads;
+
+  init_palette();
+  if (bench_tty) {
+    bench_pty(bench_w, bench_h, bench_frames);
+    return 0;
+  }
+  // The benchmark grid is in heat cells; bench_render covers every mode
+  set_glyph_mode(bench ? GLYPH_FULL : glyph_arg);
+  if (bench) {
+    backend = BACKEND_TEXT; // the benches compare the backends
+    int max_threads = threads ? threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    run_bench(bench_w, bench_h, bench_frames, max_threads, bench_batch_n);
+    return 0;
+  }
+
+  // Registered before init_terminal() so it runs after the terminal is back
+  if (show_stats)
+    atexit(print_stats);
+  start_time = now_sec();
+
+  init_terminal();
+  frame_clock_init(&frame_clock); // before the threads, see there
+  pacer.period = 1.0 / target_fps;
+  sync_output = sync_mode == SYNC_ON ||
+                (sync_mode == SYNC_AUTO && probe_sync_output());
+  if (backend == BACKEND_KITTY) {
+    kitty_use_shm = probe_kitty_shm();
+    atexit(kitty_shm_release); // runs after stop_writer()
+  }
+  if (writer_thread) {
+    start_writer();
+    atexit(stop_writer); // runs before restore_terminal()
+  }
+
+  struct winsize w;
+  ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+  set_cell_pixels(&w);
+  resize_buffers(w.ws_col, w.ws_row);
+
+  frame_clock.deadline = now_sec(); // the first frame is due now
+  while (running) {
+    int steps = frame_start(&frame_clock, pacer.period);
+    if (resize_pending) {
+      resize_pending = false;
+      ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+      if (w.ws_col != term_cols || w.ws_row != term_rows) {
+        set_cell_pixels(&w);
+        resize_buffers(w.ws_col, w.ws_row);
+        screen_clear = true; // Clear screen on resize
+      }
+    }
+
+    for (int i = 0; i < steps; i++)
+      doomfire_step(fire);
+    pace(&pacer, render());
+
+    frame_clock.deadline += pacer.period;
+    frame_wait(&frame_clock);
+  }
+
+  return 0;
+}
\ No newline at end of file